@@ -17,6 +17,7 @@
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/i2c.h>
+#include <linux/regmap.h>
 #include <linux/clk.h>
 #include <linux/delay.h>
 #include <linux/gpio/consumer.h>
@@ -42,6 +43,8 @@
 #include <linux/fs.h>
 #include <uapi/linux/media.h>
 #include <linux/clk-provider.h>
+#include <linux/math64.h>
+#include <linux/gcd.h>
 #include <sound/soc.h>
 #include <sound/soc-dai.h>
 #include <sound/pcm_params.h>
@@ -51,6 +54,11 @@
 /****************************************/
 /* ADV7482 I2C slave address definition */
 /****************************************/
+/*
+ * Default map addresses. The register tables use them to name the map;
+ * the address actually used on the bus comes from the "reg-names" and
+ * "reg" properties of each instance.
+ */
 #define ADV7482_I2C_IO			0x70	/* IO Map */
 #define ADV7482_I2C_DPLL		0x26	/* DPLL Map */
 #define ADV7482_I2C_CP			0x22	/* CP Map */
@@ -64,6 +72,37 @@
 #define ADV7482_I2C_TXA			0x4A	/* CSI-TXA Map */
 #define ADV7482_I2C_WAIT		0xFE	/* Wait x mesec */
 #define ADV7482_I2C_EOR			0xFF	/* End Mark */
+#define ADV7482_MAX_BURST		256	/* Longest table write burst */
+
+/* One regmap per I2C map, indexed by page */
+enum adv7482_page {
+	ADV7482_PAGE_IO,
+	ADV7482_PAGE_DPLL,
+	ADV7482_PAGE_CP,
+	ADV7482_PAGE_HDMI,
+	ADV7482_PAGE_EDID,
+	ADV7482_PAGE_REPEATER,
+	ADV7482_PAGE_INFOFRAME,
+	ADV7482_PAGE_CEC,
+	ADV7482_PAGE_SDP,
+	ADV7482_PAGE_TXB,
+	ADV7482_PAGE_TXA,
+	ADV7482_PAGE_MAX
+};
+
+static const u8 adv7482_page_addr[ADV7482_PAGE_MAX] = {
+	[ADV7482_PAGE_IO]		= ADV7482_I2C_IO,
+	[ADV7482_PAGE_DPLL]		= ADV7482_I2C_DPLL,
+	[ADV7482_PAGE_CP]		= ADV7482_I2C_CP,
+	[ADV7482_PAGE_HDMI]		= ADV7482_I2C_HDMI,
+	[ADV7482_PAGE_EDID]		= ADV7482_I2C_EDID,
+	[ADV7482_PAGE_REPEATER]		= ADV7482_I2C_REPEATER,
+	[ADV7482_PAGE_INFOFRAME]	= ADV7482_I2C_INFOFRAME,
+	[ADV7482_PAGE_CEC]		= ADV7482_I2C_CEC,
+	[ADV7482_PAGE_SDP]		= ADV7482_I2C_SDP,
+	[ADV7482_PAGE_TXB]		= ADV7482_I2C_TXB,
+	[ADV7482_PAGE_TXA]		= ADV7482_I2C_TXA,
+};
 /****************************************/
 /* ADV7482 IO register definition       */
 /****************************************/
@@ -72,11 +111,27 @@
 #define ADV7482_IO_RD_INFO2_REG	0xE0	/* chip version register */
 #define ADV7482_IO_CP_DATAPATH_REG	0x03	/* datapath ctrl */
 #define ADV7482_IO_CP_COLORSPACE_REG	0x04
+#define ADV7482_IO_INP_CS_MASK		0xF0	/* INP_COLOR_SPACE[3:0] */
+#define ADV7482_IO_INP_CS_SHIFT		4
+#define ADV7482_IO_INP_CS_RGB_LIM	0x0
+#define ADV7482_IO_INP_CS_RGB_FULL	0x1
+#define ADV7482_IO_INP_CS_YUV601	0x2
+#define ADV7482_IO_INP_CS_YUV709	0x3
+#define ADV7482_IO_INP_CS_YUV601_FULL	0x6
+#define ADV7482_IO_INP_CS_YUV709_FULL	0x7
+#define ADV7482_IO_INP_CS_AUTO		0xF
+#define ADV7482_IO_OP_RANGE_LIM		0x04	/* Limited range output */
 #define ADV7482_IO_CP_VID_STD_REG	0x05	/* Video Standard */
+#define ADV7482_IO_CP_V_FREQ_MASK	0x70	/* V_FREQ in datapath ctrl */
+#define ADV7482_IO_CP_V_FREQ_SHIFT	4
 /* Power Management */
 #define ADV7482_IO_PWR_MAN_REG	0x0C	/* Power management register */
 #define ADV7482_IO_PWR_ON		0xE0	/* Power on */
 #define ADV7482_IO_PWR_OFF		0x00	/* Power down */
+#define ADV7482_IO_TX_EN_REG	0x10	/* CSI-2 transmitter enables */
+#define ADV7482_IO_CSI4_EN		0x80	/* TXA */
+#define ADV7482_IO_CSI1_EN		0x40	/* TXB */
+#define ADV7482_IO_CSI4_IN_SEL_AFE	0x08	/* TXA carries the SDP output */
 #define ADV7482_HDMI_DDC_PWRDN	0x73	/* Power DDC pads control register */
 #define ADV7482_HDMI_DDC_PWR_ON		0x00	/* Power on */
 #define ADV7482_HDMI_DDC_PWR_OFF	0x01	/* Power down */
@@ -103,10 +158,44 @@
 #define ADV7482_IO_CP_VID_STD_XGA75	0x8E
 #define ADV7482_IO_CP_VID_STD_XGA85	0x8F
 #define ADV7482_IO_CP_VID_STD_UXGA60	0x96
+/* HDMI graphics standard with the CP following the received DE */
+#define ADV7482_IO_CP_VID_STD_HDMI_GR	0x82
 #define ADV7482_IO_CSI4_EN_ENABLE       0x80
 #define ADV7482_IO_CSI4_EN_DISABLE      0x00
 #define ADV7482_IO_CSI2_EN_ENABLE       0x40
 #define ADV7482_IO_CSI2_EN_DISABLE      0x00
+/* Interrupt pin configuration: active low, open drain, until cleared */
+#define ADV7482_IO_INT_CFG_REG		0x40
+#define ADV7482_IO_INT_CFG_VAL		0xC1
+/* HDMI level interrupts: raw, status, clear, mask2, mask1 */
+#define ADV7482_IO_HDMI_LVL_RAW_REG	0x71
+#define ADV7482_IO_HDMI_LVL_ST_REG	0x72
+#define ADV7482_IO_HDMI_LVL_CLR_REG	0x73
+#define ADV7482_IO_HDMI_LVL_MASK_REG	0x75
+#define ADV7482_INT_AVI_INFO		0x01
+#define ADV7482_INT_AUDIO_INFO		0x02
+#define ADV7482_INT_AV_MUTE		0x40
+#define ADV7482_INT_LVL_MASK		(ADV7482_INT_AVI_INFO | \
+					 ADV7482_INT_AUDIO_INFO | \
+					 ADV7482_INT_AV_MUTE)
+/* HDMI lock interrupts: raw, status, clear, mask2, mask1 */
+#define ADV7482_IO_HDMI_LOCK_RAW_REG	0x80
+#define ADV7482_IO_HDMI_LOCK_ST_REG	0x81
+#define ADV7482_IO_HDMI_LOCK_CLR_REG	0x82
+#define ADV7482_IO_HDMI_LOCK_MASK_REG	0x84
+#define ADV7482_INT_DE_REGEN_LCK	0x01
+#define ADV7482_INT_V_LOCKED		0x02
+#define ADV7482_INT_TMDS_PLL_LCK	0x40
+#define ADV7482_INT_TMDS_CLK_DET	0x80
+#define ADV7482_INT_LOCK_MASK		(ADV7482_INT_DE_REGEN_LCK | \
+					 ADV7482_INT_V_LOCKED | \
+					 ADV7482_INT_TMDS_PLL_LCK | \
+					 ADV7482_INT_TMDS_CLK_DET)
+/* HDMI edge interrupts: status, clear, mask2, mask1 */
+#define ADV7482_IO_HDMI_EDGE_ST_REG	0x8A
+#define ADV7482_IO_HDMI_EDGE_CLR_REG	0x8B
+#define ADV7482_IO_HDMI_EDGE_MASK_REG	0x8D
+#define ADV7482_INT_NEW_SAMP_RT		0x02
 /****************************************/
 /* ADV7482 CP register definition       */
 /****************************************/
@@ -136,9 +225,42 @@
 #define ADV7482_CP_VID_ADJ_MASK		0x7F
 /* Enable color controls */
 #define ADV7482_CP_VID_ADJ_ENABLE	0x80
+/* Free run line length in crystal clocks, [10:8] then [7:0] */
+#define ADV7482_CP_CH1_FR_LL_REG	0x8F
+/* Free run lines per frame, [11:4] then [3:0] in the upper nibble */
+#define ADV7482_CP_LCOUNT_MAX_REG	0xAB
+/* Crystal frequency the free run line length is counted in */
+#define ADV7482_CP_FSC			28636360
+/* Pattern generator: enable and pattern select */
+#define ADV7482_CP_PAT_GEN_REG		0x37
+#define ADV7482_CP_PAT_GEN_EN		0x80
+/* HSync shift: control, then the shift for the two HSync edges */
+#define ADV7482_CP_HSHIFT_CTRL_REG	0x8B
+#define ADV7482_CP_HSHIFT_START_REG	0x8C
+#define ADV7482_CP_HSHIFT_END_REG	0x8D
+/* HDMI free run: enable, and also on a mismatch with the set standard */
+#define ADV7482_CP_HDMI_FRUN_REG	0xBA
+#define ADV7482_CP_HDMI_FRUN_EN		0x01
+#define ADV7482_CP_HDMI_FRUN_MODE1	0x02
+/* Free run colour: manual select, then channels A/B/C (R/G/B) */
+#define ADV7482_CP_DEF_COL_REG		0xBF
+#define ADV7482_CP_DEF_COL_MAN		0x04
+#define ADV7482_CP_DEF_COL_A_REG	0xC0
+#define ADV7482_CP_DEF_COL_B_REG	0xC1
+#define ADV7482_CP_DEF_COL_C_REG	0xC2
 /****************************************/
 /* ADV7482 HDMI register definition     */
 /****************************************/
+/* Sync polarity register */
+#define ADV7482_HDMI_POLARITY_REG		0x05
+/* VS_POLARITY flag */
+#define ADV7482_HDMI_VS_POL_FLG			0x10
+/* HS_POLARITY flag */
+#define ADV7482_HDMI_HS_POL_FLG			0x20
+/* Pixel repetition factor minus one, from the AVI InfoFrame */
+#define ADV7482_HDMI_PIXEL_REP_MASK		0x0F
+#define ADV7482_HDMI_PIXEL_REP(pol) \
+			(((pol) & ADV7482_HDMI_PIXEL_REP_MASK) + 1)
 /* HDMI status register */
 #define ADV7482_HDMI_STATUS1_REG		0x07
 /* VERT_FILTER_LOCKED flag */
@@ -165,8 +287,75 @@
 #define ADV7482_HDMI_F1HEIGHT_MSBS_MASK		0x1F
 /* FIELD1_HEIGHT[7:0] register */
 #define ADV7482_HDMI_F1HEIGHT_REG		0x0C
+/* Measured horizontal timings, 13 bit big endian pairs */
+#define ADV7482_HDMI_TOTAL_WIDTH_REG		0x1E
+#define ADV7482_HDMI_HFRONT_PORCH_REG		0x20
+#define ADV7482_HDMI_HSYNC_WIDTH_REG		0x22
+#define ADV7482_HDMI_HBACK_PORCH_REG		0x24
+#define ADV7482_HDMI_H_MASK			0x1FFF
+/* Measured vertical timings, 14 bit big endian pairs in half lines */
+#define ADV7482_HDMI_F0_TOTAL_HEIGHT_REG	0x26
+#define ADV7482_HDMI_F1_TOTAL_HEIGHT_REG	0x28
+#define ADV7482_HDMI_F0_VFRONT_PORCH_REG	0x2A
+#define ADV7482_HDMI_F1_VFRONT_PORCH_REG	0x2C
+#define ADV7482_HDMI_F0_VSYNC_WIDTH_REG		0x2E
+#define ADV7482_HDMI_F1_VSYNC_WIDTH_REG		0x30
+#define ADV7482_HDMI_F0_VBACK_PORCH_REG		0x32
+#define ADV7482_HDMI_F1_VBACK_PORCH_REG		0x34
+#define ADV7482_HDMI_V_MASK			0x3FFF
+/* Last register of the measurement block */
+#define ADV7482_HDMI_MEAS_END_REG		0x35
+/* TMDS frequency in MHz[8:1], MHz[0] and 1/128 MHz fraction */
+#define ADV7482_HDMI_TMDS_FREQ_REG		0x51
+/* Tolerance when matching measured timings to the standards */
+#define ADV7482_HDMI_PIXELCLOCK_TOL		250000
+/* IEC 60958 channel status byte 3, sampling frequency in [3:0] */
+#define ADV7482_HDMI_CS_DATA3_REG		0x39
+#define ADV7482_HDMI_CS_FS_MASK			0x0F
+/* Audio clock regeneration, CTS[19:0] then N[19:0] */
+#define ADV7482_HDMI_ACR_REG			0x5B
+#define ADV7482_HDMI_ACR_LEN			5
+/* Used until the source has sent a rate */
+#define ADV7482_AUDIO_DEF_RATE			48000
+#define ADV7482_AUDIO_DEF_FS			256
 
 #define ADV7482_HDMI_I2S		0x03
+/* Pixel repetition removal, set from the received factor */
+#define ADV7482_HDMI_DEREP_REG			0x41
+#define ADV7482_HDMI_DEREP_OVERRIDE		0x10
+#define ADV7482_HDMI_DEREP_N_MASK		0x0F
+/* Hot plug assert: manual enable and level */
+#define ADV7482_HDMI_HPA_MAN_REG		0x6C
+#define ADV7482_HDMI_HPA_REG			0xF8
+/****************************************/
+/* ADV7482 Repeater register definition */
+/****************************************/
+/* EDID image size, in 16 byte units */
+#define ADV7482_RPT_EDID_SIZE_REG		0x70
+/* Manual enable of the E-EDID on port A */
+#define ADV7482_RPT_EDID_EN_REG			0x74
+#define ADV7482_EDID_BLOCK_SIZE			128
+#define ADV7482_EDID_MAX_BLOCKS			2
+/* Minimum hot plug low time for the source to notice (HDMI 1.4) */
+#define ADV7482_HPA_LOW_MS			100
+/****************************************/
+/* ADV7482 InfoFrame register definition */
+/****************************************/
+/* Checksum and payload of the last received packet */
+#define ADV7482_INFOFRAME_AVI_PB_REG		0x00
+#define ADV7482_INFOFRAME_AUDIO_PB_REG		0x1C
+/* Packet type, version and length */
+#define ADV7482_INFOFRAME_AVI_HDR_REG		0xE0
+#define ADV7482_INFOFRAME_AUDIO_HDR_REG		0xE3
+#define ADV7482_INFOFRAME_HDR_LEN		3
+
+/* Private controls */
+#define V4L2_CID_USER_ADV7482_BASE	(V4L2_CID_USER_BASE + 0x10f0)
+#define ADV7482_CID_AV_MUTE		(V4L2_CID_USER_ADV7482_BASE + 0)
+#define ADV7482_CID_EDID_PRESET		(V4L2_CID_USER_ADV7482_BASE + 1)
+#define ADV7482_CID_AUDIO_SPF		(V4L2_CID_USER_ADV7482_BASE + 2)
+#define ADV7482_CID_FREE_RUN_COLOR_MANUAL	(V4L2_CID_USER_ADV7482_BASE + 3)
+#define ADV7482_CID_FREE_RUN_COLOR	(V4L2_CID_USER_ADV7482_BASE + 4)
 
 struct adv7482_sdp_main_info {
 	u8			status_reg_10;
@@ -219,6 +408,10 @@ struct adv7482_sdp_main_info {
 #define ADV7482_SDP_BRI_MAX		127
 /* Hue */
 #define ADV7482_SDP_REG_HUE		0x0b	/*Signed, inverted */
+#define ADV7482_SDP_REG_DEF		0x0c	/* Default value Y */
+#define ADV7482_SDP_DEF_VAL_EN		0x01	/* Force free run */
+#define ADV7482_SDP_REG_FRP		0x14	/* Free run pattern select */
+#define ADV7482_SDP_FRP_MASK		0x07
 #define ADV7482_SDP_HUE_MIN		-127
 #define ADV7482_SDP_HUE_DEF		0
 #define ADV7482_SDP_HUE_MAX		128
@@ -258,8 +451,19 @@ struct adv7482_sdp_main_info {
 #define ADV7482_SDP_R_REG_10_AUTOD_SECAM	0x50
 #define ADV7482_SDP_R_REG_10_AUTOD_PAL_COMB	0x60
 #define ADV7482_SDP_R_REG_10_AUTOD_SECAM_525	0x70
+/* Interrupt bank 3 of the SDP sub map 1 */
+#define ADV7482_SDP_INT_STATUS3_REG		0x4E
+#define ADV7482_SDP_INT_CLEAR3_REG		0x4F
+#define ADV7482_SDP_INT_MASK3_REG		0x50
+#define ADV7482_SDP_INT_V_LOCK_CHNG		0x02
+#define ADV7482_SDP_INT_AD_CHNG			0x08
+#define ADV7482_SDP_INT_MASK \
+			(ADV7482_SDP_INT_V_LOCK_CHNG | ADV7482_SDP_INT_AD_CHNG)
 #define ADV7482_MAX_WIDTH		1920
 #define ADV7482_MAX_HEIGHT		1080
+/* Without a source the CP free runs at ADV7482_IO_CP_VID_STD_480P */
+#define ADV7482_FREE_RUN_WIDTH		720
+#define ADV7482_FREE_RUN_HEIGHT		480
 /****************************************/
 /* ADV7482 structure definition         */
 /****************************************/
@@ -281,22 +485,29 @@ struct adv748x_hdmi_video_standards {
 	struct v4l2_dv_timings timings;
 	u8 vid_std;
 	u8 v_freq;
+	u8 hshift;	/* CP HSync shift, 0 for none */
 };
 
+/* Modes with a 40 clock HSync that must be shifted left in the CP */
+#define ADV7482_CP_HSHIFT_720	0xD8
+#define ADV7482_CP_HSHIFT_1080	0xD4
+
 static const struct adv748x_hdmi_video_standards
 adv748x_hdmi_video_standards[] = {
 	{ V4L2_DV_BT_CEA_720X480P59_94, 0x4a, 0x00 },
 	{ V4L2_DV_BT_CEA_720X576P50, 0x4b, 0x00 },
-	{ V4L2_DV_BT_CEA_1280X720P60, 0x53, 0x00 },
-	{ V4L2_DV_BT_CEA_1280X720P50, 0x53, 0x01 },
-	{ V4L2_DV_BT_CEA_1280X720P30, 0x53, 0x02 },
-	{ V4L2_DV_BT_CEA_1280X720P25, 0x53, 0x03 },
-	{ V4L2_DV_BT_CEA_1280X720P24, 0x53, 0x04 },
-	{ V4L2_DV_BT_CEA_1920X1080P60, 0x5e, 0x00 },
-	{ V4L2_DV_BT_CEA_1920X1080P50, 0x5e, 0x01 },
-	{ V4L2_DV_BT_CEA_1920X1080P30, 0x5e, 0x02 },
-	{ V4L2_DV_BT_CEA_1920X1080P25, 0x5e, 0x03 },
-	{ V4L2_DV_BT_CEA_1920X1080P24, 0x5e, 0x04 },
+	{ V4L2_DV_BT_CEA_1280X720P60, 0x53, 0x00, ADV7482_CP_HSHIFT_720 },
+	{ V4L2_DV_BT_CEA_1280X720P50, 0x53, 0x01, ADV7482_CP_HSHIFT_720 },
+	{ V4L2_DV_BT_CEA_1280X720P30, 0x53, 0x02, ADV7482_CP_HSHIFT_720 },
+	{ V4L2_DV_BT_CEA_1280X720P25, 0x53, 0x03, ADV7482_CP_HSHIFT_720 },
+	{ V4L2_DV_BT_CEA_1280X720P24, 0x53, 0x04, ADV7482_CP_HSHIFT_720 },
+	{ V4L2_DV_BT_CEA_1920X1080I60, 0x54, 0x00, ADV7482_CP_HSHIFT_1080 },
+	{ V4L2_DV_BT_CEA_1920X1080I50, 0x54, 0x01, ADV7482_CP_HSHIFT_1080 },
+	{ V4L2_DV_BT_CEA_1920X1080P60, 0x5e, 0x00, ADV7482_CP_HSHIFT_1080 },
+	{ V4L2_DV_BT_CEA_1920X1080P50, 0x5e, 0x01, ADV7482_CP_HSHIFT_1080 },
+	{ V4L2_DV_BT_CEA_1920X1080P30, 0x5e, 0x02, ADV7482_CP_HSHIFT_1080 },
+	{ V4L2_DV_BT_CEA_1920X1080P25, 0x5e, 0x03, ADV7482_CP_HSHIFT_1080 },
+	{ V4L2_DV_BT_CEA_1920X1080P24, 0x5e, 0x04, ADV7482_CP_HSHIFT_1080 },
 	/* SVGA */
 	{ V4L2_DV_BT_DMT_800X600P56, 0x80, 0x00 },
 	{ V4L2_DV_BT_DMT_800X600P60, 0x81, 0x00 },
@@ -328,38 +539,137 @@ static const struct adv7482_reg_value adv7482_sw_reset[] = {
 	{ADV7482_I2C_IO, 0xF2, 0x01},	/* Enable I2C Read Auto-Increment */
 	{ADV7482_I2C_EOR, 0xFF, 0xFF}	/* End of register table */
 };
-static const struct adv7482_reg_value adv7482_set_slave_address[] = {
-	/* I2C Slave Address settings */
-	{ADV7482_I2C_IO, 0xF3, ADV7482_I2C_DPLL * 2},	/* DPLL Map */
-	{ADV7482_I2C_IO, 0xF4, ADV7482_I2C_CP * 2},	/* CP Map */
-	{ADV7482_I2C_IO, 0xF5, ADV7482_I2C_HDMI * 2},	/* HDMI Map */
-	{ADV7482_I2C_IO, 0xF6, ADV7482_I2C_EDID * 2},	/* EDID Map */
-	{ADV7482_I2C_IO, 0xF7, ADV7482_I2C_REPEATER * 2},
-						/* HDMI RX Repeater Map */
-	{ADV7482_I2C_IO, 0xF8, ADV7482_I2C_INFOFRAME * 2},
-						/* HDMI RX InfoFrame Map */
-	{ADV7482_I2C_IO, 0xFA, ADV7482_I2C_CEC * 2},	/* CEC Map */
-	{ADV7482_I2C_IO, 0xFB, ADV7482_I2C_SDP * 2},	/* SDP Map */
-	{ADV7482_I2C_IO, 0xFC, ADV7482_I2C_TXB * 2},	/* CSI-TXB Map */
-	{ADV7482_I2C_IO, 0xFD, ADV7482_I2C_TXA * 2},	/* CSI-TXA Map */
+/* IO map register holding the slave address of each other map */
+static const u8 adv7482_page_slave_reg[ADV7482_PAGE_MAX] = {
+	[ADV7482_PAGE_DPLL]		= 0xF3,
+	[ADV7482_PAGE_CP]		= 0xF4,
+	[ADV7482_PAGE_HDMI]		= 0xF5,
+	[ADV7482_PAGE_EDID]		= 0xF6,
+	[ADV7482_PAGE_REPEATER]		= 0xF7,
+	[ADV7482_PAGE_INFOFRAME]	= 0xF8,
+	[ADV7482_PAGE_CEC]		= 0xFA,
+	[ADV7482_PAGE_SDP]		= 0xFB,
+	[ADV7482_PAGE_TXB]		= 0xFC,
+	[ADV7482_PAGE_TXA]		= 0xFD,
+};
+/* Two block EDID with 1080p60 preferred and a CEA block with audio */
+static const u8 adv7482_edid_default[] = {
+	0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00,
+	0x4C, 0x2D, 0x9E, 0x07, 0x00, 0x00, 0x00, 0x00,
+	0x25, 0x15, 0x01, 0x03, 0x80, 0x3C, 0x22, 0x78,
+	0x2A, 0xEE, 0x91, 0xA3, 0x54, 0x4C, 0x99, 0x26,
+	0x0F, 0x50, 0x54, 0x23, 0x08, 0x00, 0x81, 0x80,
+	0x81, 0x40, 0x81, 0x00, 0x95, 0x00, 0xB3, 0x00,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x3A,
+	0x80, 0x18, 0x71, 0x38, 0x2D, 0x40, 0x58, 0x2C,
+	0x45, 0x00, 0x56, 0x50, 0x21, 0x00, 0x00, 0x1E,
+	0x02, 0x3A, 0x80, 0xD0, 0x72, 0x38, 0x2D, 0x40,
+	0x10, 0x2C, 0x45, 0x80, 0x56, 0x50, 0x21, 0x00,
+	0x00, 0x1E, 0x00, 0x00, 0x00, 0xFD, 0x00, 0x18,
+	0x4B, 0x1A, 0x51, 0x17, 0x00, 0x0A, 0x20, 0x20,
+	0x20, 0x20, 0x20, 0x20, 0x00, 0x00, 0x00, 0xFC,
+	0x00, 0x53, 0x32, 0x37, 0x41, 0x39, 0x35, 0x30,
+	0x44, 0x0A, 0x20, 0x20, 0x20, 0x20, 0x01, 0x07,
+	0x02, 0x03, 0x28, 0xF1, 0x49, 0x90, 0x1F, 0x04,
+	0x13, 0x05, 0x14, 0x03, 0x12, 0x20, 0x23, 0x09,
+	0x07, 0x07, 0x83, 0x01, 0x00, 0x00, 0xE2, 0x00,
+	0x0F, 0x6E, 0x03, 0x0C, 0x00, 0x10, 0x00, 0x00,
+	0x2D, 0x20, 0x90, 0x04, 0x08, 0x10, 0x18, 0x10,
+	0x01, 0x1D, 0x00, 0x72, 0x51, 0xD0, 0x1E, 0x20,
+	0x6E, 0x28, 0x55, 0x00, 0x56, 0x50, 0x21, 0x00,
+	0x00, 0x1E, 0x01, 0x1D, 0x00, 0xBC, 0x52, 0xD0,
+	0x1E, 0x20, 0xB8, 0x28, 0x55, 0x40, 0x56, 0x50,
+	0x21, 0x00, 0x00, 0x1E, 0x01, 0x1D, 0x80, 0x18,
+	0x71, 0x1C, 0x16, 0x20, 0x58, 0x2C, 0x25, 0x00,
+	0x56, 0x50, 0x21, 0x00, 0x00, 0x9E, 0x01, 0x1D,
+	0x80, 0xD0, 0x72, 0x1C, 0x16, 0x20, 0x10, 0x2C,
+	0x25, 0x80, 0x56, 0x50, 0x21, 0x00, 0x00, 0x9E,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xD6,
+};
+/* Single block EDID with 1920x1080p30 preferred and 640x480p60 */
+static const u8 adv7482_edid_1080p30[] = {
+	0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00,
+	0x04, 0x89, 0x82, 0x74, 0x00, 0x00, 0x00, 0x00,
+	0x01, 0x1E, 0x01, 0x03, 0x80, 0x34, 0x1D, 0x78,
+	0x0A, 0xEE, 0x91, 0xA3, 0x54, 0x4C, 0x99, 0x26,
+	0x0F, 0x50, 0x54, 0x20, 0x00, 0x00, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x1D,
+	0x80, 0x18, 0x71, 0x38, 0x2D, 0x40, 0x58, 0x2C,
+	0x45, 0x00, 0x09, 0x25, 0x21, 0x00, 0x00, 0x1E,
+	0x00, 0x00, 0x00, 0xFD, 0x00, 0x18, 0x3D, 0x1E,
+	0x2E, 0x08, 0x00, 0x0A, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x00, 0x00, 0x00, 0xFC, 0x00, 0x41,
+	0x44, 0x56, 0x37, 0x34, 0x38, 0x32, 0x20, 0x31,
+	0x30, 0x38, 0x30, 0x0A, 0x00, 0x00, 0x00, 0x10,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x88,
+};
+/* Single block EDID with 1280x1024p60 preferred, VGA, SVGA and XGA */
+static const u8 adv7482_edid_sxga[] = {
+	0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00,
+	0x04, 0x89, 0x82, 0x74, 0x00, 0x00, 0x00, 0x00,
+	0x01, 0x1E, 0x01, 0x03, 0x80, 0x34, 0x1D, 0x78,
+	0x0A, 0xEE, 0x91, 0xA3, 0x54, 0x4C, 0x99, 0x26,
+	0x0F, 0x50, 0x54, 0x21, 0x08, 0x00, 0x81, 0x80,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x30, 0x2A,
+	0x00, 0x98, 0x51, 0x00, 0x2A, 0x40, 0x30, 0x70,
+	0x13, 0x00, 0x78, 0x2D, 0x11, 0x00, 0x00, 0x1E,
+	0x00, 0x00, 0x00, 0xFD, 0x00, 0x38, 0x4C, 0x1E,
+	0x51, 0x0B, 0x00, 0x0A, 0x20, 0x20, 0x20, 0x20,
+	0x20, 0x20, 0x00, 0x00, 0x00, 0xFC, 0x00, 0x41,
+	0x44, 0x56, 0x37, 0x34, 0x38, 0x32, 0x20, 0x53,
+	0x58, 0x47, 0x41, 0x0A, 0x00, 0x00, 0x00, 0x10,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x8F,
+};
+struct adv7482_edid_preset {
+	const char	*name;
+	const u8	*edid;
+	unsigned int	blocks;
+};
+
+static const struct adv7482_edid_preset adv7482_edid_presets[] = {
+	{ "Default", adv7482_edid_default, 2 },
+	{ "1920x1080p30", adv7482_edid_1080p30, 1 },
+	{ "1280x1024p60", adv7482_edid_sxga, 1 },
+};
+
+/* Selected by a VIDIOC_S_EDID, the image is whatever userspace wrote */
+#define ADV7482_EDID_CUSTOM	ARRAY_SIZE(adv7482_edid_presets)
+
+static const char * const adv7482_edid_preset_names[] = {
+	"Default",
+	"1920x1080p30",
+	"1280x1024p60",
+	"Custom",
+	NULL,
+};
+
+static unsigned int edid_preset;
+module_param(edid_preset, uint, 0444);
+MODULE_PARM_DESC(edid_preset, "EDID preset loaded at probe (0-2)");
+
+static const struct adv7482_reg_value adv7482_edid_disable[] = {
+	{ADV7482_I2C_HDMI, ADV7482_HDMI_HPA_MAN_REG, 0x00},
+	{ADV7482_I2C_HDMI, ADV7482_HDMI_HPA_REG, 0x00},	/* HPA low */
+	{ADV7482_I2C_REPEATER, ADV7482_RPT_EDID_EN_REG, 0x00},
+	{ADV7482_I2C_EOR, 0xFF, 0xFF}	/* End of register table */
+};
+
+static const struct adv7482_reg_value adv7482_edid_enable[] = {
+	{ADV7482_I2C_REPEATER, ADV7482_RPT_EDID_EN_REG, 0x01},
+	{ADV7482_I2C_HDMI, ADV7482_HDMI_HPA_MAN_REG, 0x01},
+	{ADV7482_I2C_HDMI, ADV7482_HDMI_HPA_REG, 0x01},	/* HPA high */
 	{ADV7482_I2C_EOR, 0xFF, 0xFF}	/* End of register table */
 };
+
 /* Supported Formats For Script Below */
 /* - 01-29 HDMI to MIPI TxA CSI 4-Lane - RGB888: */
 static const struct adv7482_reg_value adv7482_init_txa_4lane[] = {
-	/* I2C Slave Address settings */
-	{ADV7482_I2C_IO, 0xF3, ADV7482_I2C_DPLL * 2},	/* DPLL Map */
-	{ADV7482_I2C_IO, 0xF4, ADV7482_I2C_CP * 2},	/* CP Map */
-	{ADV7482_I2C_IO, 0xF5, ADV7482_I2C_HDMI * 2},	/* HDMI Map */
-	{ADV7482_I2C_IO, 0xF6, ADV7482_I2C_EDID * 2},	/* EDID Map */
-	{ADV7482_I2C_IO, 0xF7, ADV7482_I2C_REPEATER * 2},
-						/* HDMI RX Repeater Map */
-	{ADV7482_I2C_IO, 0xF8, ADV7482_I2C_INFOFRAME * 2},
-						/* HDMI RX InfoFrame Map */
-	{ADV7482_I2C_IO, 0xFA, ADV7482_I2C_CEC * 2},	/* CEC Map */
-	{ADV7482_I2C_IO, 0xFB, ADV7482_I2C_SDP * 2},	/* SDP Map */
-	{ADV7482_I2C_IO, 0xFC, ADV7482_I2C_TXB * 2},	/* CSI-TXB Map */
-	{ADV7482_I2C_IO, 0xFD, ADV7482_I2C_TXA * 2},	/* CSI-TXA Map */
+	/* Map slave addresses are programmed by adv7482_bootstrap() */
 	/* Disable chip powerdown & Enable HDMI Rx block */
 	{ADV7482_I2C_IO, 0x00, 0x40},
 	{ADV7482_I2C_REPEATER, 0x40, 0x83},	/* Enable HDCP 1.1 */
@@ -385,272 +695,7 @@ static const struct adv7482_reg_value adv7482_init_txa_4lane[] = {
 	{ADV7482_I2C_HDMI, 0xF8, 0x00},	/* HPA Asserted */
 	{ADV7482_I2C_HDMI, 0x0F, 0x00},	/* Audio Mute Speed Set to Fastest */
 					/* (Smallest Step Size) */
-	/* EDID */
-	/* Header information(0-19th byte) */
-{ADV7482_I2C_EDID,0x00,0x00},
-{ADV7482_I2C_EDID,0x01,0xFF},
-{ADV7482_I2C_EDID,0x02,0xFF},
-{ADV7482_I2C_EDID,0x03,0xFF},
-{ADV7482_I2C_EDID,0x04,0xFF},
-{ADV7482_I2C_EDID,0x05,0xFF},
-{ADV7482_I2C_EDID,0x06,0xFF},
-{ADV7482_I2C_EDID,0x07,0x00},
-{ADV7482_I2C_EDID,0x08,0x4C},
-{ADV7482_I2C_EDID,0x09,0x2D},
-{ADV7482_I2C_EDID,0x0A,0x9E},
-{ADV7482_I2C_EDID,0x0B,0x07},
-{ADV7482_I2C_EDID,0x0C,0x00},
-{ADV7482_I2C_EDID,0x0D,0x00},
-{ADV7482_I2C_EDID,0x0E,0x00},
-{ADV7482_I2C_EDID,0x0F,0x00},
-{ADV7482_I2C_EDID,0x10,0x25},
-{ADV7482_I2C_EDID,0x11,0x15},
-{ADV7482_I2C_EDID,0x12,0x01},
-{ADV7482_I2C_EDID,0x13,0x03},
-{ADV7482_I2C_EDID,0x14,0x80},
-{ADV7482_I2C_EDID,0x15,0x3C},
-{ADV7482_I2C_EDID,0x16,0x22},
-{ADV7482_I2C_EDID,0x17,0x78},
-{ADV7482_I2C_EDID,0x18,0x2A},
-{ADV7482_I2C_EDID,0x19,0xEE},
-{ADV7482_I2C_EDID,0x1A,0x91},
-{ADV7482_I2C_EDID,0x1B,0xA3},
-{ADV7482_I2C_EDID,0x1C,0x54},
-{ADV7482_I2C_EDID,0x1D,0x4C},
-{ADV7482_I2C_EDID,0x1E,0x99},
-{ADV7482_I2C_EDID,0x1F,0x26},
-{ADV7482_I2C_EDID,0x20,0x0F},
-{ADV7482_I2C_EDID,0x21,0x50},
-{ADV7482_I2C_EDID,0x22,0x54},
-{ADV7482_I2C_EDID,0x23,0x23},
-{ADV7482_I2C_EDID,0x24,0x08},
-{ADV7482_I2C_EDID,0x25,0x00},
-{ADV7482_I2C_EDID,0x26,0x81},
-{ADV7482_I2C_EDID,0x27,0x80},
-{ADV7482_I2C_EDID,0x28,0x81},
-{ADV7482_I2C_EDID,0x29,0x40},
-{ADV7482_I2C_EDID,0x2A,0x81},
-{ADV7482_I2C_EDID,0x2B,0x00},
-{ADV7482_I2C_EDID,0x2C,0x95},
-{ADV7482_I2C_EDID,0x2D,0x00},
-{ADV7482_I2C_EDID,0x2E,0xB3},
-{ADV7482_I2C_EDID,0x2F,0x00},
-{ADV7482_I2C_EDID,0x30,0x01},
-{ADV7482_I2C_EDID,0x31,0x01},
-{ADV7482_I2C_EDID,0x32,0x01},
-{ADV7482_I2C_EDID,0x33,0x01},
-{ADV7482_I2C_EDID,0x34,0x01},
-{ADV7482_I2C_EDID,0x35,0x01},
-{ADV7482_I2C_EDID,0x36,0x02},
-{ADV7482_I2C_EDID,0x37,0x3A},
-{ADV7482_I2C_EDID,0x38,0x80},
-{ADV7482_I2C_EDID,0x39,0x18},
-{ADV7482_I2C_EDID,0x3A,0x71},
-{ADV7482_I2C_EDID,0x3B,0x38},
-{ADV7482_I2C_EDID,0x3C,0x2D},
-{ADV7482_I2C_EDID,0x3D,0x40},
-{ADV7482_I2C_EDID,0x3E,0x58},
-{ADV7482_I2C_EDID,0x3F,0x2C},
-{ADV7482_I2C_EDID,0x40,0x45},
-{ADV7482_I2C_EDID,0x41,0x00},
-{ADV7482_I2C_EDID,0x42,0x56},
-{ADV7482_I2C_EDID,0x43,0x50},
-{ADV7482_I2C_EDID,0x44,0x21},
-{ADV7482_I2C_EDID,0x45,0x00},
-{ADV7482_I2C_EDID,0x46,0x00},
-{ADV7482_I2C_EDID,0x47,0x1E},
-{ADV7482_I2C_EDID,0x48,0x02},
-{ADV7482_I2C_EDID,0x49,0x3A},
-{ADV7482_I2C_EDID,0x4A,0x80},
-{ADV7482_I2C_EDID,0x4B,0xD0},
-{ADV7482_I2C_EDID,0x4C,0x72},
-{ADV7482_I2C_EDID,0x4D,0x38},
-{ADV7482_I2C_EDID,0x4E,0x2D},
-{ADV7482_I2C_EDID,0x4F,0x40},
-{ADV7482_I2C_EDID,0x50,0x10},
-{ADV7482_I2C_EDID,0x51,0x2C},
-{ADV7482_I2C_EDID,0x52,0x45},
-{ADV7482_I2C_EDID,0x53,0x80},
-{ADV7482_I2C_EDID,0x54,0x56},
-{ADV7482_I2C_EDID,0x55,0x50},
-{ADV7482_I2C_EDID,0x56,0x21},
-{ADV7482_I2C_EDID,0x57,0x00},
-{ADV7482_I2C_EDID,0x58,0x00},
-{ADV7482_I2C_EDID,0x59,0x1E},
-{ADV7482_I2C_EDID,0x5A,0x00},
-{ADV7482_I2C_EDID,0x5B,0x00},
-{ADV7482_I2C_EDID,0x5C,0x00},
-{ADV7482_I2C_EDID,0x5D,0xFD},
-{ADV7482_I2C_EDID,0x5E,0x00},
-{ADV7482_I2C_EDID,0x5F,0x18},
-{ADV7482_I2C_EDID,0x60,0x4B},
-{ADV7482_I2C_EDID,0x61,0x1A},
-{ADV7482_I2C_EDID,0x62,0x51},
-{ADV7482_I2C_EDID,0x63,0x17},
-{ADV7482_I2C_EDID,0x64,0x00},
-{ADV7482_I2C_EDID,0x65,0x0A},
-{ADV7482_I2C_EDID,0x66,0x20},
-{ADV7482_I2C_EDID,0x67,0x20},
-{ADV7482_I2C_EDID,0x68,0x20},
-{ADV7482_I2C_EDID,0x69,0x20},
-{ADV7482_I2C_EDID,0x6A,0x20},
-{ADV7482_I2C_EDID,0x6B,0x20},
-{ADV7482_I2C_EDID,0x6C,0x00},
-{ADV7482_I2C_EDID,0x6D,0x00},
-{ADV7482_I2C_EDID,0x6E,0x00},
-{ADV7482_I2C_EDID,0x6F,0xFC},
-{ADV7482_I2C_EDID,0x70,0x00},
-{ADV7482_I2C_EDID,0x71,0x53},
-{ADV7482_I2C_EDID,0x72,0x32},
-{ADV7482_I2C_EDID,0x73,0x37},
-{ADV7482_I2C_EDID,0x74,0x41},
-{ADV7482_I2C_EDID,0x75,0x39},
-{ADV7482_I2C_EDID,0x76,0x35},
-{ADV7482_I2C_EDID,0x77,0x30},
-{ADV7482_I2C_EDID,0x78,0x44},
-{ADV7482_I2C_EDID,0x79,0x0A},
-{ADV7482_I2C_EDID,0x7A,0x20},
-{ADV7482_I2C_EDID,0x7B,0x20},
-{ADV7482_I2C_EDID,0x7C,0x20},
-{ADV7482_I2C_EDID,0x7D,0x20},
-{ADV7482_I2C_EDID,0x7E,0x01},
-{ADV7482_I2C_EDID,0x7F,0x07},
-{ADV7482_I2C_EDID,0x80,0x02},
-{ADV7482_I2C_EDID,0x81,0x03},
-{ADV7482_I2C_EDID,0x82,0x28},
-{ADV7482_I2C_EDID,0x83,0xF1},
-{ADV7482_I2C_EDID,0x84,0x49},
-{ADV7482_I2C_EDID,0x85,0x90},
-{ADV7482_I2C_EDID,0x86,0x1F},
-{ADV7482_I2C_EDID,0x87,0x04},
-{ADV7482_I2C_EDID,0x88,0x13},
-{ADV7482_I2C_EDID,0x89,0x05},
-{ADV7482_I2C_EDID,0x8A,0x14},
-{ADV7482_I2C_EDID,0x8B,0x03},
-{ADV7482_I2C_EDID,0x8C,0x12},
-{ADV7482_I2C_EDID,0x8D,0x20},
-{ADV7482_I2C_EDID,0x8E,0x23},
-{ADV7482_I2C_EDID,0x8F,0x09},
-{ADV7482_I2C_EDID,0x90,0x07},
-{ADV7482_I2C_EDID,0x91,0x07},
-{ADV7482_I2C_EDID,0x92,0x83},
-{ADV7482_I2C_EDID,0x93,0x01},
-{ADV7482_I2C_EDID,0x94,0x00},
-{ADV7482_I2C_EDID,0x95,0x00},
-{ADV7482_I2C_EDID,0x96,0xE2},
-{ADV7482_I2C_EDID,0x97,0x00},
-{ADV7482_I2C_EDID,0x98,0x0F},
-{ADV7482_I2C_EDID,0x99,0x6E},
-{ADV7482_I2C_EDID,0x9A,0x03},
-{ADV7482_I2C_EDID,0x9B,0x0C},
-{ADV7482_I2C_EDID,0x9C,0x00},
-{ADV7482_I2C_EDID,0x9D,0x10},
-{ADV7482_I2C_EDID,0x9E,0x00},
-{ADV7482_I2C_EDID,0x9F,0x00},
-{ADV7482_I2C_EDID,0xA0,0x2D},
-{ADV7482_I2C_EDID,0xA1,0x20},
-{ADV7482_I2C_EDID,0xA2,0x90},
-{ADV7482_I2C_EDID,0xA3,0x04},
-{ADV7482_I2C_EDID,0xA4,0x08},
-{ADV7482_I2C_EDID,0xA5,0x10},
-{ADV7482_I2C_EDID,0xA6,0x18},
-{ADV7482_I2C_EDID,0xA7,0x10},
-{ADV7482_I2C_EDID,0xA8,0x01},
-{ADV7482_I2C_EDID,0xA9,0x1D},
-{ADV7482_I2C_EDID,0xAA,0x00},
-{ADV7482_I2C_EDID,0xAB,0x72},
-{ADV7482_I2C_EDID,0xAC,0x51},
-{ADV7482_I2C_EDID,0xAD,0xD0},
-{ADV7482_I2C_EDID,0xAE,0x1E},
-{ADV7482_I2C_EDID,0xAF,0x20},
-{ADV7482_I2C_EDID,0xB0,0x6E},
-{ADV7482_I2C_EDID,0xB1,0x28},
-{ADV7482_I2C_EDID,0xB2,0x55},
-{ADV7482_I2C_EDID,0xB3,0x00},
-{ADV7482_I2C_EDID,0xB4,0x56},
-{ADV7482_I2C_EDID,0xB5,0x50},
-{ADV7482_I2C_EDID,0xB6,0x21},
-{ADV7482_I2C_EDID,0xB7,0x00},
-{ADV7482_I2C_EDID,0xB8,0x00},
-{ADV7482_I2C_EDID,0xB9,0x1E},
-{ADV7482_I2C_EDID,0xBA,0x01},
-{ADV7482_I2C_EDID,0xBB,0x1D},
-{ADV7482_I2C_EDID,0xBC,0x00},
-{ADV7482_I2C_EDID,0xBD,0xBC},
-{ADV7482_I2C_EDID,0xBE,0x52},
-{ADV7482_I2C_EDID,0xBF,0xD0},
-{ADV7482_I2C_EDID,0xC0,0x1E},
-{ADV7482_I2C_EDID,0xC1,0x20},
-{ADV7482_I2C_EDID,0xC2,0xB8},
-{ADV7482_I2C_EDID,0xC3,0x28},
-{ADV7482_I2C_EDID,0xC4,0x55},
-{ADV7482_I2C_EDID,0xC5,0x40},
-{ADV7482_I2C_EDID,0xC6,0x56},
-{ADV7482_I2C_EDID,0xC7,0x50},
-{ADV7482_I2C_EDID,0xC8,0x21},
-{ADV7482_I2C_EDID,0xC9,0x00},
-{ADV7482_I2C_EDID,0xCA,0x00},
-{ADV7482_I2C_EDID,0xCB,0x1E},
-{ADV7482_I2C_EDID,0xCC,0x01},
-{ADV7482_I2C_EDID,0xCD,0x1D},
-{ADV7482_I2C_EDID,0xCE,0x80},
-{ADV7482_I2C_EDID,0xCF,0x18},
-{ADV7482_I2C_EDID,0xD0,0x71},
-{ADV7482_I2C_EDID,0xD1,0x1C},
-{ADV7482_I2C_EDID,0xD2,0x16},
-{ADV7482_I2C_EDID,0xD3,0x20},
-{ADV7482_I2C_EDID,0xD4,0x58},
-{ADV7482_I2C_EDID,0xD5,0x2C},
-{ADV7482_I2C_EDID,0xD6,0x25},
-{ADV7482_I2C_EDID,0xD7,0x00},
-{ADV7482_I2C_EDID,0xD8,0x56},
-{ADV7482_I2C_EDID,0xD9,0x50},
-{ADV7482_I2C_EDID,0xDA,0x21},
-{ADV7482_I2C_EDID,0xDB,0x00},
-{ADV7482_I2C_EDID,0xDC,0x00},
-{ADV7482_I2C_EDID,0xDD,0x9E},
-{ADV7482_I2C_EDID,0xDE,0x01},
-{ADV7482_I2C_EDID,0xDF,0x1D},
-{ADV7482_I2C_EDID,0xE0,0x80},
-{ADV7482_I2C_EDID,0xE1,0xD0},
-{ADV7482_I2C_EDID,0xE2,0x72},
-{ADV7482_I2C_EDID,0xE3,0x1C},
-{ADV7482_I2C_EDID,0xE4,0x16},
-{ADV7482_I2C_EDID,0xE5,0x20},
-{ADV7482_I2C_EDID,0xE6,0x10},
-{ADV7482_I2C_EDID,0xE7,0x2C},
-{ADV7482_I2C_EDID,0xE8,0x25},
-{ADV7482_I2C_EDID,0xE9,0x80},
-{ADV7482_I2C_EDID,0xEA,0x56},
-{ADV7482_I2C_EDID,0xEB,0x50},
-{ADV7482_I2C_EDID,0xEC,0x21},
-{ADV7482_I2C_EDID,0xED,0x00},
-{ADV7482_I2C_EDID,0xEE,0x00},
-{ADV7482_I2C_EDID,0xEF,0x9E},
-{ADV7482_I2C_EDID,0xF0,0x00},
-{ADV7482_I2C_EDID,0xF1,0x00},
-{ADV7482_I2C_EDID,0xF2,0x00},
-{ADV7482_I2C_EDID,0xF3,0x00},
-{ADV7482_I2C_EDID,0xF4,0x00},
-{ADV7482_I2C_EDID,0xF5,0x00},
-{ADV7482_I2C_EDID,0xF6,0x00},
-{ADV7482_I2C_EDID,0xF7,0x00},
-{ADV7482_I2C_EDID,0xF8,0x00},
-{ADV7482_I2C_EDID,0xF9,0x00},
-{ADV7482_I2C_EDID,0xFA,0x00},
-{ADV7482_I2C_EDID,0xFB,0x00},
-{ADV7482_I2C_EDID,0xFC,0x00},
-{ADV7482_I2C_EDID,0xFD,0x00},
-{ADV7482_I2C_EDID,0xFE,0x00},
-{ADV7482_I2C_EDID,0xFF,0xD6},
-{ADV7482_I2C_REPEATER, 0x70, 0x10},
-					/* EDID image, in 128-byte blocks. */
-
-    {ADV7482_I2C_HDMI, 0x6C, 0x01},	/* HPA Manual Enable */
-	{ADV7482_I2C_HDMI, 0xF8, 0x01},	/* HPA Asserted */
-
-	{ADV7482_I2C_REPEATER, 0x74, 0x01},
-				/* Manual enable active for E-EDID on Port A */
+	/* EDID and hot plug are set up by adv7482_write_edid() */
 	{ADV7482_I2C_IO, 0x04, 0x00},	/* RGB Out of CP */ 
 	{ADV7482_I2C_IO, 0x12, 0xF2},
 		/* CSC Depends on ip Packets - SDR 444 */
@@ -658,6 +703,9 @@ static const struct adv7482_reg_value adv7482_init_txa_4lane[] = {
 		/* Luma & Chroma Values Can Reach 254d */
 	{ADV7482_I2C_IO, 0x03, 0x86},	/* CP-Insert_AV_Code */
 	{ADV7482_I2C_CP, 0x7C, 0x00},	/* ADI Required Write */
+	/* Free run at the programmed standard without a matching input */
+	{ADV7482_I2C_CP, ADV7482_CP_HDMI_FRUN_REG,
+		ADV7482_CP_HDMI_FRUN_EN | ADV7482_CP_HDMI_FRUN_MODE1},
 	{ADV7482_I2C_IO, 0x0C, 0xE0},	/* Enable LLC_DLL & Double LLC Timing */
 	{ADV7482_I2C_IO, 0x0E, 0xDD},	/* LLC/PIX/SPI PINS TRISTATED AUD */
 					/* Outputs Enabled */
@@ -679,10 +727,7 @@ static const struct adv7482_reg_value adv7482_init_txa_4lane[] = {
 	{ADV7482_I2C_TXA, 0xC1, 0x2B},	/* ADI Required Write */
 	{ADV7482_I2C_WAIT, 0x00, 0x01},	/* delay 1 */
 	{ADV7482_I2C_TXA, 0x31, 0x80},	/* ADI Required Write */
-	/* for debug */
-#ifdef REL_DGB_FORCE_TO_SEND_COLORBAR
-	{ADV7482_I2C_CP, 0x37, 0x81},	/* Output Colorbars Pattern */
-#endif
+	/* Test patterns are set through V4L2_CID_TEST_PATTERN */
 	{ADV7482_I2C_EOR, 0xFF, 0xFF}	/* End of register table */
 };
 
@@ -690,11 +735,13 @@ static const struct adv7482_reg_value adv7482_init_txa_4lane[] = {
 static const struct adv7482_reg_value adv7482_init_txa_rgb[] = {
 	{ADV7482_I2C_IO, 0x04, 0x02},	/* RGB Out of CP */
 	{ADV7482_I2C_IO, 0x12, 0xF0},
+	{ADV7482_I2C_EOR, 0xFF, 0xFF}	/* End of register table */
 };
 
 static const struct adv7482_reg_value adv7482_init_txa_yuv[] = {
 	{ADV7482_I2C_IO, 0x04, 0x00},	/* RGB Out of CP */
 	{ADV7482_I2C_IO, 0x12, 0xF2}, 
+	{ADV7482_I2C_EOR, 0xFF, 0xFF}	/* End of register table */
 };
 
 /* 02-01 Analog CVBS to MIPI TX-B CSI 1-Lane - */
@@ -703,19 +750,7 @@ static const struct adv7482_reg_value adv7482_init_txb_1lane[] = {
 	{ADV7482_I2C_IO, 0x00, 0x30},
 		/* Disable chip powerdown - powerdown Rx */
 	{ADV7482_I2C_IO, 0xF2, 0x01},	/* Enable I2C Read Auto-Increment */
-	/* I2C Slave Address settings */
-	{ADV7482_I2C_IO, 0xF3, ADV7482_I2C_DPLL * 2},	/* DPLL Map */
-	{ADV7482_I2C_IO, 0xF4, ADV7482_I2C_CP * 2},	/* CP Map */
-	{ADV7482_I2C_IO, 0xF5, ADV7482_I2C_HDMI * 2},	/* HDMI Map */
-	{ADV7482_I2C_IO, 0xF6, ADV7482_I2C_EDID * 2},	/* EDID Map */
-	{ADV7482_I2C_IO, 0xF7, ADV7482_I2C_REPEATER * 2},
-						/* HDMI RX Repeater Map */
-	{ADV7482_I2C_IO, 0xF8, ADV7482_I2C_INFOFRAME * 2},
-						/* HDMI RX InfoFrame Map */
-	{ADV7482_I2C_IO, 0xFA, ADV7482_I2C_CEC * 2},	/* CEC Map */
-	{ADV7482_I2C_IO, 0xFB, ADV7482_I2C_SDP * 2},	/* SDP Map */
-	{ADV7482_I2C_IO, 0xFC, ADV7482_I2C_TXB * 2},	/* CSI-TXB Map */
-	{ADV7482_I2C_IO, 0xFD, ADV7482_I2C_TXA * 2},	/* CSI-TXA Map */
+	/* Map slave addresses are programmed by adv7482_bootstrap() */
 	{ADV7482_I2C_IO, 0x0E, 0xFF},	/* LLC/PIX/AUD/SPI PINS TRISTATED */
 	{ADV7482_I2C_SDP, ADV7482_SDP_REG_PWR_MAN, ADV7482_SDP_PWR_MAN_ON}, /* Exit Power Down Mode */
 	{ADV7482_I2C_SDP, 0x52, 0xCD},	/* ADI Required Write */
@@ -741,10 +776,6 @@ static const struct adv7482_reg_value adv7482_init_txb_1lane[] = {
 	{ADV7482_I2C_SDP, 0x31, 0x12},	/* ADI Required Write */
 	{ADV7482_I2C_SDP, 0xE6, 0x4F},
 		/* Set V bit end position manually in NTSC mode */
-#ifdef REL_DGB_FORCE_TO_SEND_COLORBAR
-	{ADV7482_I2C_SDP, 0x0C, 0x01},	/* ColorBar */
-	{ADV7482_I2C_SDP, 0x14, 0x01},	/* ColorBar */
-#endif
 	/* Enable 1-Lane MIPI Tx, */
 	/* enable pixel output and route SD through Pixel port */
 	{ADV7482_I2C_IO, 0x10, 0x70},
@@ -892,30 +923,61 @@ struct adv7482_link_config {
 };
 struct adv7482_state {
 	struct v4l2_ctrl_handler		ctrl_hdl;
+	struct v4l2_ctrl			*av_mute_ctrl;
+	struct v4l2_ctrl			*edid_preset_ctrl;
 	struct v4l2_subdev			sd;
 	struct media_pad			pad;
 	 /* mutual excl. when accessing chip */
 	struct mutex				mutex;
 	int					irq;
+	bool					irq_active;
+	bool					hdmi_locked;
 	v4l2_std_id				curr_norm;
 	bool					autodetect;
 	bool					powered;
 	const struct adv7482_color_format	*cfmt;
+	/* Detected input format, valid until the next lock change */
+	struct v4l2_mbus_framefmt		fmt;
+	bool					fmt_valid;
+	/* Output colour space table last written */
+	const struct adv7482_reg_value		*csc;
+	/* Last InfoFrames received, valid while the source sends them */
+	struct hdmi_avi_infoframe		avi;
+	bool					avi_valid;
+	struct hdmi_audio_infoframe		audio_if;
+	bool					audio_if_valid;
+	/* EDID presented on the HDMI port */
+	u8					edid[ADV7482_EDID_MAX_BLOCKS *
+						     ADV7482_EDID_BLOCK_SIZE];
+	unsigned int				edid_blocks;
+	bool					hpa;
 	u32					width;
 	u32					height;
 	struct i2c_client			*client;
-	unsigned int				register_page;
+	struct i2c_client			*i2c_clients[ADV7482_PAGE_MAX];
+	struct regmap				*regmap[ADV7482_PAGE_MAX];
 	struct i2c_client			*csi_client;
 	enum v4l2_field				field;
 	struct device				*dev;
 	struct adv7482_link_config		mipi_csi2_link[2];
 	struct v4l2_dv_timings timings;
+	/* TXA lane count reported to the receiver, 0 until latched */
+	unsigned int				txa_lanes;
+
+	struct work_struct			init_work;
+	struct completion			init_done;
+	int					init_ret;
 
 	struct snd_soc_dai dai;
 	struct snd_soc_dai_driver dai_drv;
 
 	char *mclk_name;
-	struct clk_hw *mclk_hw;
+	/* MCLK out, mclk_fs times the received sample rate */
+	struct clk_hw mclk_hw;
+	unsigned int mclk_fs;
+	unsigned int audio_rate;
+	/* open capture substream, stopped when audio_rate changes */
+	struct snd_pcm_substream *audio_sub;
 	unsigned int freq;
 	unsigned int fmt, tdm;
 };
@@ -944,8 +1006,12 @@ static const struct v4l2_dv_timings_cap adv7482_timings_cap = {
 			     ADV748X_HDMI_MIN_HEIGHT, ADV748X_HDMI_MAX_HEIGHT,
 			     ADV748X_HDMI_MIN_PIXELCLOCK,
 			     ADV748X_HDMI_MAX_PIXELCLOCK,
-			     V4L2_DV_BT_STD_CEA861 | V4L2_DV_BT_STD_DMT,
-			     V4L2_DV_BT_CAP_PROGRESSIVE)
+			     V4L2_DV_BT_STD_CEA861 | V4L2_DV_BT_STD_DMT |
+			     V4L2_DV_BT_STD_CVT | V4L2_DV_BT_STD_GTF,
+			     V4L2_DV_BT_CAP_PROGRESSIVE |
+			     V4L2_DV_BT_CAP_INTERLACED |
+			     V4L2_DV_BT_CAP_REDUCED_BLANKING |
+			     V4L2_DV_BT_CAP_CUSTOM)
 };
 
 /*****************************************************************************/
@@ -964,110 +1030,348 @@ static inline struct adv7482_state *dai_to_state(struct snd_soc_dai *dai)
 	return container_of(dai, struct adv7482_state, dai);
 }
 
+static int adv7482_wait_init(struct adv7482_state *state);
+static int adv7482_update_infoframes(struct adv7482_state *state);
+static int adv7482_s_ctrl(struct v4l2_ctrl *ctrl);
+
+/*
+ * Status, interrupt and measurement registers change under our feet and
+ * bypass the cache. Everything else is only written by this driver.
+ */
+static bool adv7482_io_volatile(struct device *dev, unsigned int reg)
+{
+	/*
+	 * Interrupt banks and status readbacks, the read-only chip revision
+	 * and software reset. A cached read-only value would be written
+	 * back by regcache_sync().
+	 */
+	return (reg >= 0x3F && reg <= 0x9F) ||
+	       (reg >= ADV7482_IO_RD_INFO1_REG &&
+		reg <= ADV7482_IO_RD_INFO2_REG) ||
+	       reg == 0xFF;
+}
+
+static bool adv7482_cp_volatile(struct device *dev, unsigned int reg)
+{
+	/* Lock and measurement readbacks */
+	return reg >= 0xB1 && reg <= 0xB8;
+}
+
+static bool adv7482_hdmi_volatile(struct device *dev, unsigned int reg)
+{
+	/* Link status, timing measurement, channel status, TMDS and ACR */
+	return (reg >= 0x04 && reg <= 0x0C) ||
+	       (reg >= 0x1E && reg <= 0x3A) ||
+	       (reg >= 0x51 && reg <= 0x53) ||
+	       (reg >= 0x5B && reg <= 0x5F);
+}
+
+static bool adv7482_repeater_volatile(struct device *dev, unsigned int reg)
+{
+	/* HDCP keys and status */
+	return reg <= 0x3F;
+}
+
+static bool adv7482_sdp_volatile(struct device *dev, unsigned int reg)
+{
+	/*
+	 * Register 0x0E switches the rest of the map between the main and
+	 * sub maps, so only the switch itself can be cached.
+	 */
+	return reg != ADV7482_SDP_REG_CTRL;
+}
+
+/*
+ * No register defaults are given: the cache only holds what the driver
+ * wrote or read, so creating a map costs no I2C traffic and
+ * regcache_sync() writes back exactly the registers the driver set up.
+ */
+#define ADV7482_REGMAP_CONFIG(_name, _volatile, _cache)	\
+	{						\
+		.name		= _name,		\
+		.reg_bits	= 8,			\
+		.val_bits	= 8,			\
+		.max_register	= 0xFF,			\
+		.volatile_reg	= _volatile,		\
+		.cache_type	= _cache,		\
+	}
+
+static const struct regmap_config adv7482_regmap_cfg[ADV7482_PAGE_MAX] = {
+	[ADV7482_PAGE_IO] = ADV7482_REGMAP_CONFIG("io",
+			adv7482_io_volatile, REGCACHE_RBTREE),
+	[ADV7482_PAGE_DPLL] = ADV7482_REGMAP_CONFIG("dpll",
+			NULL, REGCACHE_RBTREE),
+	[ADV7482_PAGE_CP] = ADV7482_REGMAP_CONFIG("cp",
+			adv7482_cp_volatile, REGCACHE_RBTREE),
+	[ADV7482_PAGE_HDMI] = ADV7482_REGMAP_CONFIG("hdmi",
+			adv7482_hdmi_volatile, REGCACHE_RBTREE),
+	[ADV7482_PAGE_EDID] = ADV7482_REGMAP_CONFIG("edid",
+			NULL, REGCACHE_RBTREE),
+	[ADV7482_PAGE_REPEATER] = ADV7482_REGMAP_CONFIG("repeater",
+			adv7482_repeater_volatile, REGCACHE_RBTREE),
+	[ADV7482_PAGE_INFOFRAME] = ADV7482_REGMAP_CONFIG("infoframe",
+			NULL, REGCACHE_NONE),
+	[ADV7482_PAGE_CEC] = ADV7482_REGMAP_CONFIG("cec",
+			NULL, REGCACHE_NONE),
+	[ADV7482_PAGE_SDP] = ADV7482_REGMAP_CONFIG("sdp",
+			adv7482_sdp_volatile, REGCACHE_RBTREE),
+	[ADV7482_PAGE_TXB] = ADV7482_REGMAP_CONFIG("txb",
+			NULL, REGCACHE_RBTREE),
+	[ADV7482_PAGE_TXA] = ADV7482_REGMAP_CONFIG("txa",
+			NULL, REGCACHE_RBTREE),
+};
+
+static void adv7482_unregister_client(void *data)
+{
+	i2c_unregister_device(data);
+}
+
+/*
+ * adv7482_init_clients() - Create an I2C client for each map
+ * @state: pointer to private state structure
+ *
+ * The IO map is the probed client. The others are ancillary clients at
+ * the address the device tree gives for the map name (e.g. reg-names =
+ * "main", "dpll", "cp", ...), or at the default address. They are
+ * programmed into the chip by adv7482_bootstrap(), so several chips can
+ * share a bus.
+ */
+static int adv7482_init_clients(struct adv7482_state *state)
+{
+	struct i2c_client *client = state->client;
+	unsigned int page;
+	int ret;
+
+	state->i2c_clients[ADV7482_PAGE_IO] = client;
+	for (page = ADV7482_PAGE_IO + 1; page < ADV7482_PAGE_MAX; page++) {
+		state->i2c_clients[page] = i2c_new_ancillary_device(client,
+				adv7482_regmap_cfg[page].name,
+				adv7482_page_addr[page]);
+		if (IS_ERR(state->i2c_clients[page]))
+			return PTR_ERR(state->i2c_clients[page]);
+		ret = devm_add_action_or_reset(state->dev,
+				adv7482_unregister_client,
+				state->i2c_clients[page]);
+		if (ret)
+			return ret;
+		dev_dbg(state->dev, "%s map at 0x%02x\n",
+			adv7482_regmap_cfg[page].name,
+			state->i2c_clients[page]->addr);
+	}
+
+	return 0;
+}
+
+/*
+ * adv7482_init_regmaps() - Create a regmap for each I2C map
+ * @state: pointer to private state structure
+ *
+ * Must run after adv7482_bootstrap(), the maps need their slave addresses.
+ */
+static int adv7482_init_regmaps(struct adv7482_state *state)
+{
+	unsigned int page;
+
+	for (page = 0; page < ADV7482_PAGE_MAX; page++) {
+		state->regmap[page] = devm_regmap_init_i2c(state->i2c_clients[page],
+						&adv7482_regmap_cfg[page]);
+		if (IS_ERR(state->regmap[page])) {
+			int ret = PTR_ERR(state->regmap[page]);
+
+			state->regmap[page] = NULL;
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * adv7482_bootstrap() - Reset the chip and program the map addresses
+ * @state: pointer to private state structure
+ *
+ * Talks to the IO map directly, bypassing the register cache: after the
+ * reset the cache no longer matches the hardware until it is synced.
+ */
+static int adv7482_bootstrap(struct adv7482_state *state)
+{
+	const struct adv7482_reg_value *regs;
+	unsigned int page;
+	int ret;
+
+	for (regs = adv7482_sw_reset; regs->addr != ADV7482_I2C_EOR; regs++) {
+		if (regs->addr == ADV7482_I2C_WAIT) {
+			msleep(regs->value);
+			continue;
+		}
+		ret = i2c_smbus_write_byte_data(state->client,
+						regs->reg, regs->value);
+		if (ret < 0)
+			return ret;
+	}
+
+	/* Point every map at this instance's client */
+	for (page = ADV7482_PAGE_IO + 1; page < ADV7482_PAGE_MAX; page++) {
+		ret = i2c_smbus_write_byte_data(state->client,
+				adv7482_page_slave_reg[page],
+				state->i2c_clients[page]->addr << 1);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Look up a map by the default address the register tables name it by */
+static struct regmap *adv7482_regmap(struct adv7482_state *state, u8 addr)
+{
+	unsigned int page;
+
+	for (page = 0; page < ADV7482_PAGE_MAX; page++)
+		if (adv7482_page_addr[page] == addr)
+			return state->regmap[page];
+
+	return NULL;
+}
+
 /*
  * adv7482_write_registers() - Write adv7482 device registers
- * @client: pointer to i2c_client structure
+ * @state: pointer to private state structure
  * @regs: pointer to adv7482_reg_value structure
  *
- * Write the specified adv7482 register's values.
+ * Write the specified adv7482 register's values. Runs of consecutive
+ * registers on the same map go out as one auto-increment burst, a WAIT
+ * entry ends the run.
  */
-static int adv7482_write_registers(struct i2c_client *client,
+static int adv7482_write_registers(struct adv7482_state *state,
 					const struct adv7482_reg_value *regs)
 {
-	struct i2c_msg msg;
-	u8 data_buf[2];
-	int ret = -EINVAL;
-	if (!client->adapter)
-		return -ENODEV;
-	msg.flags = 0;
-	msg.len = 2;
-	msg.buf = &data_buf[0];
-	
+	u8 buf[ADV7482_MAX_BURST];
+	struct regmap *map;
+	unsigned int len;
+	int ret;
+
 	while (regs->addr != ADV7482_I2C_EOR) {
-		if (regs->addr == ADV7482_I2C_WAIT)
-		{
-		
+		if (regs->addr == ADV7482_I2C_WAIT) {
 			msleep(regs->value);
+			regs++;
+			continue;
 		}
-		else {
-			msg.addr = regs->addr;
-			data_buf[0] = regs->reg;
-			data_buf[1] = regs->value;
-			
-			ret = i2c_transfer(client->adapter, &msg, 1);
-			if (ret < 0)
+
+		map = adv7482_regmap(state, regs->addr);
+		if (!map)
+			return -EINVAL;
+
+		buf[0] = regs->value;
+		for (len = 1; len < ARRAY_SIZE(buf); len++) {
+			if (regs[len].addr != regs->addr ||
+			    regs[len].reg != regs->reg + len)
 				break;
+			buf[len] = regs[len].value;
 		}
-		regs++;
+
+		if (len == 1)
+			ret = regmap_write(map, regs->reg, regs->value);
+		else
+			ret = regmap_bulk_write(map, regs->reg, buf, len);
+		if (ret < 0)
+			return ret;
+		regs += len;
 	}
-	return (ret < 0) ? ret : 0;
+	return 0;
 }
 /*
  * adv7482_write_register() - Write adv7482 device register
- * @client: pointer to i2c_client structure
+ * @state: pointer to private state structure
  * @addr: i2c slave address of adv7482 device
  * @reg: adv7482 device register address
  * @value: the value to be written
  *
  * Write the specified adv7482 register's value.
  */
-static int adv7482_write_register(struct i2c_client *client,
+static int adv7482_write_register(struct adv7482_state *state,
 		u8 addr, u8 reg, u8 value)
 {
-	struct adv7482_reg_value regs[2];
-	int ret;
-	regs[0].addr = addr;
-	regs[0].reg = reg;
-	regs[0].value = value;
-	regs[1].addr = ADV7482_I2C_EOR;
-	regs[1].reg = 0xFF;
-	regs[1].value = 0xFF;
-	ret = adv7482_write_registers(client, regs);
-	return ret;
+	struct regmap *map = adv7482_regmap(state, addr);
+
+	if (!map)
+		return -EINVAL;
+	return regmap_write(map, reg, value);
+}
+/*
+ * adv7482_update_bits() - Update bits of an adv7482 device register
+ * @state: pointer to private state structure
+ * @addr: i2c slave address of adv7482 device
+ * @reg: adv7482 device register address
+ * @mask: bits to update
+ * @value: new value of the bits in @mask
+ *
+ * The write is skipped when the (cached) register already holds the value.
+ */
+static int adv7482_update_bits(struct adv7482_state *state,
+		u8 addr, u8 reg, u8 mask, u8 value)
+{
+	struct regmap *map = adv7482_regmap(state, addr);
+
+	if (!map)
+		return -EINVAL;
+	return regmap_update_bits(map, reg, mask, value);
 }
 /*
  * adv7482_read_register() - Read adv7482 device register
- * @client: pointer to i2c_client structure
+ * @state: pointer to private state structure
  * @addr: i2c slave address of adv7482 device
  * @reg: adv7482 device register address
  * @value: pointer to the value
  *
  * Read the specified adv7482 register's value.
  */
-static int adv7482_read_register(struct i2c_client *client,
+static int adv7482_read_register(struct adv7482_state *state,
 		u8 addr, u8 reg, u8 *value)
 {
-	struct i2c_msg msg[2];
-	u8 reg_buf, data_buf;
+	struct regmap *map = adv7482_regmap(state, addr);
+	unsigned int val;
 	int ret;
-	if (!client->adapter)
-		return -ENODEV;
-	msg[0].addr = addr;
-	msg[0].flags = 0;
-	msg[0].len = 1;
-	msg[0].buf = &reg_buf;
-	msg[1].addr = addr;
-	msg[1].flags = I2C_M_RD;
-	msg[1].len = 1;
-	msg[1].buf = &data_buf;
-	reg_buf = reg;
-	ret = i2c_transfer(client->adapter, msg, 2);
-	if (ret < 0)
-		return ret;
-	*value = data_buf;
-	return (ret < 0) ? ret : 0;
-}
-static int adv7482_read_sdp_main_info(struct i2c_client *client,
+
+	if (!map)
+		return -EINVAL;
+	ret = regmap_read(map, reg, &val);
+	if (ret < 0)
+		return ret;
+	*value = val;
+	return 0;
+}
+/*
+ * adv7482_read_block() - Read consecutive adv7482 device registers
+ * @state: pointer to private state structure
+ * @addr: i2c slave address of adv7482 device
+ * @reg: first adv7482 device register address
+ * @buf: buffer for the values
+ * @len: number of registers to read
+ *
+ * A range of volatile registers is fetched in a single I2C transfer.
+ */
+static int adv7482_read_block(struct adv7482_state *state,
+		u8 addr, u8 reg, u8 *buf, size_t len)
+{
+	struct regmap *map = adv7482_regmap(state, addr);
+
+	if (!map)
+		return -EINVAL;
+	return regmap_bulk_read(map, reg, buf, len);
+}
+static int adv7482_read_sdp_main_info(struct adv7482_state *state,
 		struct adv7482_sdp_main_info *info)
 {
 	int ret;
 	u8 value;
-	ret = adv7482_write_register(client, ADV7482_I2C_SDP,
-				ADV7482_SDP_REG_CTRL, ADV7482_SDP_RO_MAIN_MAP);
+	ret = adv7482_update_bits(state, ADV7482_I2C_SDP,
+				ADV7482_SDP_REG_CTRL, 0xFF,
+				ADV7482_SDP_RO_MAIN_MAP);
 	if (ret < 0)
 		return ret;
 	/* status_reg_10 */
-	ret = adv7482_read_register(client, ADV7482_I2C_SDP,
+	ret = adv7482_read_register(state, ADV7482_I2C_SDP,
 			ADV7482_SDP_R_REG_10, &value);
 	if (ret < 0)
 		return ret;
@@ -1113,7 +1417,7 @@ static int __adv7482_status(struct adv7482_state *state, u32 *status,
 	int ret;
 	u8 status_reg_10;
 	struct adv7482_sdp_main_info sdp_info;
-	ret = adv7482_read_sdp_main_info(state->client, &sdp_info);
+	ret = adv7482_read_sdp_main_info(state, &sdp_info);
 	if (ret < 0)
 		return ret;
 	status_reg_10 = sdp_info.status_reg_10;
@@ -1125,6 +1429,12 @@ static int __adv7482_status(struct adv7482_state *state, u32 *status,
 		*std = adv7482_std_to_v4l2(status_reg_10);
 	return 0;
 }
+/* Big endian register pair from a block read starting at @base */
+static u32 adv7482_hdmi_word(const u8 *buf, u8 base, u8 reg, u16 mask)
+{
+	return ((buf[reg - base] << 8) | buf[reg - base + 1]) & mask;
+}
+
 /*
  * adv7482_get_vid_info() - Get video information
  * @sd: pointer to standard V4L2 sub-device structure
@@ -1137,145 +1447,286 @@ static int __adv7482_status(struct adv7482_state *state, u32 *status,
 static int adv7482_get_vid_info(struct v4l2_subdev *sd, u8 *progressive,
 				u32 *width, u32 *height, u8 *signal)
 {
-	struct i2c_client *client = v4l2_get_subdevdata(sd);
-	u8 hdmi_int;
-	u8 msb;
-	u8 lsb;
+	struct adv7482_state *state = to_state(sd);
+	u8 st[ADV7482_HDMI_F1HEIGHT_REG - ADV7482_HDMI_POLARITY_REG + 1];
+	u8 status1, status2;
 	int ret;
-	printk("adv7482_get_vid_info++\n");
 	if (signal)
 		*signal = 0;
-	/* decide line width */
-	ret = adv7482_read_register(client, ADV7482_I2C_HDMI,
-			ADV7482_HDMI_STATUS1_REG, &msb);
+	/* Status, line width and field height in one burst */
+	ret = adv7482_read_block(state, ADV7482_I2C_HDMI,
+			ADV7482_HDMI_POLARITY_REG, st, sizeof(st));
 	if (ret < 0)
 		return ret;
-	if (!(msb & ADV7482_HDMI_VF_LOCKED_FLG) ||
-	    !(msb & ADV7482_HDMI_DERF_LOCKED_FLG))
+	status1 = st[ADV7482_HDMI_STATUS1_REG - ADV7482_HDMI_POLARITY_REG];
+	status2 = st[ADV7482_HDMI_STATUS2_REG - ADV7482_HDMI_POLARITY_REG];
+	if (!(status1 & ADV7482_HDMI_VF_LOCKED_FLG) ||
+	    !(status1 & ADV7482_HDMI_DERF_LOCKED_FLG))
 		return -EIO;
 	if (signal)
 		*signal = 1;
 	/* decide interlaced or progressive */
-	ret = adv7482_read_register(client, ADV7482_I2C_HDMI,
-			ADV7482_HDMI_STATUS2_REG, &hdmi_int);
-	if (ret < 0)
-		return ret;
-	*progressive =  1;
-	if ((hdmi_int & ADV7482_HDMI_IP_FLAG) != 0)
-		*progressive =  0;
-	ret = adv7482_read_register(client, ADV7482_I2C_HDMI,
-			ADV7482_HDMI_LWIDTH_REG, &lsb);
+	*progressive = !(status2 & ADV7482_HDMI_IP_FLAG);
+	/* Repeated pixels are removed before the CP, count them once */
+	*width = adv7482_hdmi_word(st, ADV7482_HDMI_POLARITY_REG,
+			ADV7482_HDMI_STATUS1_REG, ADV7482_HDMI_H_MASK) /
+		 ADV7482_HDMI_PIXEL_REP(st[0]);
+	/* decide lines per frame */
+	*height = adv7482_hdmi_word(st, ADV7482_HDMI_POLARITY_REG,
+			ADV7482_HDMI_F0HEIGHT_MSBS_REG, ADV7482_HDMI_H_MASK);
+	if (!(*progressive))
+		*height = *height * 2;
+	if (*width == 0 || *height == 0)
+		return -EIO;
+	v4l2_dbg(2, debug, sd, "%s: %ux%u%c\n", __func__, *width, *height,
+		 *progressive ? 'p' : 'i');
+	return 0;
+}
+/*
+ * adv7482_read_bt_timings() - Read the timings measured by the HDMI receiver
+ * @state: pointer to private state structure
+ * @timings: filled with the measured timings
+ *
+ * The status, measurement and TMDS frequency blocks are each read in one
+ * burst.
+ */
+static int adv7482_read_bt_timings(struct adv7482_state *state,
+				   struct v4l2_dv_timings *timings)
+{
+	struct v4l2_bt_timings *bt = &timings->bt;
+	u8 st[ADV7482_HDMI_F1HEIGHT_REG - ADV7482_HDMI_POLARITY_REG + 1];
+	u8 meas[ADV7482_HDMI_MEAS_END_REG - ADV7482_HDMI_TOTAL_WIDTH_REG + 1];
+	u8 tmds[2];
+	u8 status1, status2;
+	u32 freq, rep;
+	int ret;
+
+	ret = adv7482_read_block(state, ADV7482_I2C_HDMI,
+			ADV7482_HDMI_POLARITY_REG, st, sizeof(st));
 	if (ret < 0)
 		return ret;
-	*width = (u32)(ADV7482_HDMI_LWIDTH_MSBS_MASK & msb);
-	*width = (lsb | (*width << 8));
-	/* decide lines per frame */
-	ret = adv7482_read_register(client, ADV7482_I2C_HDMI,
-			ADV7482_HDMI_F0HEIGHT_MSBS_REG, &msb);
+	status1 = st[ADV7482_HDMI_STATUS1_REG - ADV7482_HDMI_POLARITY_REG];
+	status2 = st[ADV7482_HDMI_STATUS2_REG - ADV7482_HDMI_POLARITY_REG];
+	if (!(status1 & ADV7482_HDMI_VF_LOCKED_FLG) ||
+	    !(status1 & ADV7482_HDMI_DERF_LOCKED_FLG))
+		return -ENOLINK;
+
+	ret = adv7482_read_block(state, ADV7482_I2C_HDMI,
+			ADV7482_HDMI_TOTAL_WIDTH_REG, meas, sizeof(meas));
 	if (ret < 0)
 		return ret;
-	ret = adv7482_read_register(client, ADV7482_I2C_HDMI,
-			ADV7482_HDMI_F0HEIGHT_LSBS_REG, &lsb);
+	ret = adv7482_read_block(state, ADV7482_I2C_HDMI,
+			ADV7482_HDMI_TMDS_FREQ_REG, tmds, sizeof(tmds));
 	if (ret < 0)
 		return ret;
-	*height = (u32)(ADV7482_HDMI_F0HEIGHT_MSBS_MASK & msb);
-	*height = (lsb | (*height << 8));
-	if (!(*progressive))
-		*height = *height * 2;
-	if (*width == 0 || *height == 0)
-		return -EIO;
-	printk("adv7482_get_vid_info(%d,%d,%d)--\n",*progressive,*width,*height);
+
+	memset(timings, 0, sizeof(*timings));
+	timings->type = V4L2_DV_BT_656_1120;
+	bt->interlaced = (status2 & ADV7482_HDMI_IP_FLAG) ?
+			V4L2_DV_INTERLACED : V4L2_DV_PROGRESSIVE;
+	bt->width = adv7482_hdmi_word(st, ADV7482_HDMI_POLARITY_REG,
+			ADV7482_HDMI_STATUS1_REG, ADV7482_HDMI_H_MASK);
+	bt->height = adv7482_hdmi_word(st, ADV7482_HDMI_POLARITY_REG,
+			ADV7482_HDMI_F0HEIGHT_MSBS_REG, ADV7482_HDMI_H_MASK);
+	bt->hfrontporch = adv7482_hdmi_word(meas, ADV7482_HDMI_TOTAL_WIDTH_REG,
+			ADV7482_HDMI_HFRONT_PORCH_REG, ADV7482_HDMI_H_MASK);
+	bt->hsync = adv7482_hdmi_word(meas, ADV7482_HDMI_TOTAL_WIDTH_REG,
+			ADV7482_HDMI_HSYNC_WIDTH_REG, ADV7482_HDMI_H_MASK);
+	bt->hbackporch = adv7482_hdmi_word(meas, ADV7482_HDMI_TOTAL_WIDTH_REG,
+			ADV7482_HDMI_HBACK_PORCH_REG, ADV7482_HDMI_H_MASK);
+	bt->vfrontporch = adv7482_hdmi_word(meas, ADV7482_HDMI_TOTAL_WIDTH_REG,
+			ADV7482_HDMI_F0_VFRONT_PORCH_REG, ADV7482_HDMI_V_MASK) / 2;
+	bt->vsync = adv7482_hdmi_word(meas, ADV7482_HDMI_TOTAL_WIDTH_REG,
+			ADV7482_HDMI_F0_VSYNC_WIDTH_REG, ADV7482_HDMI_V_MASK) / 2;
+	bt->vbackporch = adv7482_hdmi_word(meas, ADV7482_HDMI_TOTAL_WIDTH_REG,
+			ADV7482_HDMI_F0_VBACK_PORCH_REG, ADV7482_HDMI_V_MASK) / 2;
+	if (bt->interlaced == V4L2_DV_INTERLACED) {
+		bt->height += adv7482_hdmi_word(st, ADV7482_HDMI_POLARITY_REG,
+			ADV7482_HDMI_STATUS2_REG, ADV7482_HDMI_H_MASK);
+		bt->il_vfrontporch = adv7482_hdmi_word(meas,
+			ADV7482_HDMI_TOTAL_WIDTH_REG,
+			ADV7482_HDMI_F1_VFRONT_PORCH_REG,
+			ADV7482_HDMI_V_MASK) / 2;
+		bt->il_vsync = adv7482_hdmi_word(meas,
+			ADV7482_HDMI_TOTAL_WIDTH_REG,
+			ADV7482_HDMI_F1_VSYNC_WIDTH_REG,
+			ADV7482_HDMI_V_MASK) / 2;
+		bt->il_vbackporch = adv7482_hdmi_word(meas,
+			ADV7482_HDMI_TOTAL_WIDTH_REG,
+			ADV7482_HDMI_F1_VBACK_PORCH_REG,
+			ADV7482_HDMI_V_MASK) / 2;
+	}
+	if (st[0] & ADV7482_HDMI_VS_POL_FLG)
+		bt->polarities |= V4L2_DV_VSYNC_POS_POL;
+	if (st[0] & ADV7482_HDMI_HS_POL_FLG)
+		bt->polarities |= V4L2_DV_HSYNC_POS_POL;
+
+	freq = ((tmds[0] << 1) | (tmds[1] >> 7)) * 1000000U +
+		(tmds[1] & 0x7F) * 1000000U / 128;
+	/* The TMDS clock runs faster than the pixel clock in deep colour */
+	switch ((status2 & ADV7482_HDMI_DCM_MASK) >> 6) {
+	case 1:		/* 30 bit */
+		freq = freq / 10 * 8;
+		break;
+	case 2:		/* 36 bit */
+		freq = freq / 12 * 8;
+		break;
+	}
+	/* Measured in the TMDS domain, before repetition removal */
+	rep = ADV7482_HDMI_PIXEL_REP(st[0]);
+	if (rep > 1) {
+		bt->width /= rep;
+		bt->hfrontporch /= rep;
+		bt->hsync /= rep;
+		bt->hbackporch /= rep;
+		freq /= rep;
+	}
+	bt->pixelclock = freq;
 	return 0;
 }
+
+/*
+ * adv7482_find_std() - Find the standard matching measured timings
+ * @timings: measured timings
+ *
+ * Returns the table entry, or NULL for modes the CP cannot be set up for.
+ */
+static const struct adv748x_hdmi_video_standards *
+adv7482_find_std(const struct v4l2_dv_timings *timings)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(adv748x_hdmi_video_standards); i++)
+		if (v4l2_match_dv_timings(timings,
+				&adv748x_hdmi_video_standards[i].timings,
+				ADV7482_HDMI_PIXELCLOCK_TOL, false))
+			return &adv748x_hdmi_video_standards[i];
+	return NULL;
+}
+
+/*
+ * adv7482_set_cp_timing() - Program the CP line and frame length
+ * @state: pointer to private state structure
+ * @bt: measured timings of a mode outside the table, or NULL
+ *
+ * Modes outside adv748x_hdmi_video_standards run with the CP taking its
+ * timing from the HDMI DE. The free run line length and line count then
+ * have to match the source so that free run keeps the same geometry.
+ * Table standards bring their own, so the registers are cleared.
+ */
+static int adv7482_set_cp_timing(struct adv7482_state *state,
+				 const struct v4l2_bt_timings *bt)
+{
+	struct adv7482_reg_value regs[] = {
+		{ADV7482_I2C_CP, ADV7482_CP_CH1_FR_LL_REG, 0x00},
+		{ADV7482_I2C_CP, ADV7482_CP_CH1_FR_LL_REG + 1, 0x00},
+		{ADV7482_I2C_CP, ADV7482_CP_LCOUNT_MAX_REG, 0x00},
+		{ADV7482_I2C_CP, ADV7482_CP_LCOUNT_MAX_REG + 1, 0x00},
+		{ADV7482_I2C_EOR, 0xFF, 0xFF}	/* End of register table */
+	};
+	u32 fr_ll, lcount;
+
+	if (bt && bt->pixelclock) {
+		fr_ll = div_u64((u64)V4L2_DV_BT_FRAME_WIDTH(bt) *
+				ADV7482_CP_FSC, bt->pixelclock);
+		lcount = V4L2_DV_BT_FRAME_HEIGHT(bt);
+		regs[0].value = (fr_ll >> 8) & 0x07;
+		regs[1].value = fr_ll & 0xFF;
+		regs[2].value = (lcount >> 4) & 0xFF;
+		regs[3].value = (lcount & 0x0F) << 4;
+	}
+
+	return adv7482_write_registers(state, regs);
+}
+
+/*
+ * adv7482_set_vid_info() - Program the CP for the incoming HDMI mode
+ * @sd: pointer to standard V4L2 sub-device structure
+ *
+ * Looks the measured timings up in adv748x_hdmi_video_standards and
+ * writes its video standard, vertical frequency and HSync shift. Other
+ * modes within adv7482_timings_cap, such as 1366x768 or reduced blanking
+ * 1920x1200, run from the measured timings instead. The timings also
+ * become the current format, so buffers are sized for the real mode.
+ */
 static int adv7482_set_vid_info(struct v4l2_subdev *sd)
 {
 	struct adv7482_state *state = to_state(sd);
-	struct i2c_client *client = v4l2_get_subdevdata(sd);
-	u8 progressive;
-	u8 signal;
-	u8 val = ADV7482_IO_CP_VID_STD_480P;
-	u32 width;
-	u32 height;
+	const struct adv748x_hdmi_video_standards *std;
+	const struct v4l2_bt_timings *custom = NULL;
+	struct v4l2_dv_timings timings;
+	u8 vid_std = ADV7482_IO_CP_VID_STD_480P;
+	u8 v_freq = 0;
+	u8 hshift = 0;
 	int ret;
-	/* Get video information */
-	ret = adv7482_get_vid_info(sd, &progressive, &width, &height, &signal);
-	if (ret < 0) {
-		width		= ADV7482_MAX_WIDTH;
-		height		= ADV7482_MAX_HEIGHT;
-		progressive	= 1;
-	} else {
-		if ((width == 640) &&
-			(height == 480) && (progressive == 1)) {
-			val = ADV7482_IO_CP_VID_STD_VGA60;
-			dev_info(state->dev,
-				 "Changed active resolution to 640x480p\n");
-		} else if ((width == 720) &&
-			(height == 480) && (progressive == 1)) {
-			val = ADV7482_IO_CP_VID_STD_480P;
-			dev_info(state->dev,
-				 "Changed active resolution to 720x480p\n");
-		} else if ((width == 720) &&
-			(height == 576) && (progressive == 1)) {
-			val = ADV7482_IO_CP_VID_STD_576P;
-			dev_info(state->dev,
-				 "Changed active resolution to 720x576p\n");
-		} else if ((width == 1280) &&
-			(height == 720) && (progressive == 1)) {
-			val = ADV7482_IO_CP_VID_STD_720P;
-			dev_info(state->dev,
-				 "Changed active resolution to 1280x720p\n");
-		} else if ((width == 1920) &&
-			(height == 1080) && (progressive == 1)) {
-			val = ADV7482_IO_CP_VID_STD_1080P;
-		
-		} else if ((width == 1920) &&
-			(height == 1080) && (progressive == 0)) {
-			val = ADV7482_IO_CP_VID_STD_1080I;
 
+	ret = adv7482_read_bt_timings(state, &timings);
+	if (ret == 0) {
+		std = adv7482_find_std(&timings);
+		if (std) {
+			vid_std = std->vid_std;
+			v_freq = std->v_freq;
+			hshift = std->hshift;
+			state->timings = std->timings;
+		} else if (v4l2_valid_dv_timings(&timings,
+				&adv7482_timings_cap, NULL, NULL)) {
+			vid_std = ADV7482_IO_CP_VID_STD_HDMI_GR;
+			state->timings = timings;
+			custom = &state->timings.bt;
 		} else {
 			dev_err(state->dev,
-				 "Not support resolution %dx%d%c\n",
-				  width, height, (progressive) ? 'p' : 'i');
+				"Not support resolution %ux%u%c\n",
+				timings.bt.width, timings.bt.height,
+				timings.bt.interlaced ? 'i' : 'p');
 			return -EINVAL;
 		}
-	}
-	/*
-	 * The resolution of 720p, 1080i and 1080p is Hsync width of 40 pixel
-	 * clock cycles. These resolutions must be shifted horizontally to
-	 * the left in active video mode.
-	 */
-	if ((val == ADV7482_IO_CP_VID_STD_1080I) ||
-		(val == ADV7482_IO_CP_VID_STD_1080P)) {
-		ret = adv7482_write_register(client,
-					ADV7482_I2C_CP, 0x8B, 0x43);
-		ret = adv7482_write_register(client,
-					ADV7482_I2C_CP, 0x8C, 0xD4);
-		ret = adv7482_write_register(client,
-					ADV7482_I2C_CP, 0x8B, 0x4F);
-		ret = adv7482_write_register(client,
-					ADV7482_I2C_CP, 0x8D, 0xD4);
-	} else if (val == ADV7482_IO_CP_VID_STD_720P) {
-		ret = adv7482_write_register(client,
-					ADV7482_I2C_CP, 0x8B, 0x43);
-		ret = adv7482_write_register(client,
-					ADV7482_I2C_CP, 0x8C, 0xD8);
-		ret = adv7482_write_register(client,
-					ADV7482_I2C_CP, 0x8B, 0x4F);
-		ret = adv7482_write_register(client,
-					ADV7482_I2C_CP, 0x8D, 0xD8);
+		state->fmt.width = state->timings.bt.width;
+		state->fmt.height = state->timings.bt.height;
+		state->fmt.field = state->timings.bt.interlaced ?
+			V4L2_FIELD_INTERLACED : V4L2_FIELD_NONE;
+		state->fmt_valid = true;
+		adv7482_update_infoframes(state);
+		v4l2_dbg(1, debug, sd, "Changed active resolution to %ux%u%c%s\n",
+			 state->timings.bt.width, state->timings.bt.height,
+			 state->timings.bt.interlaced ? 'i' : 'p',
+			 custom ? " (measured timings)" : "");
+	} else if (ret == -ENOLINK) {
+		/* The frames sent meanwhile have the free run geometry */
+		state->fmt.width = ADV7482_FREE_RUN_WIDTH;
+		state->fmt.height = ADV7482_FREE_RUN_HEIGHT;
+		state->fmt.field = V4L2_FIELD_NONE;
+		state->fmt_valid = true;
 	} else {
-		ret = adv7482_write_register(client,
-					ADV7482_I2C_CP, 0x8B, 0x40);
-		ret = adv7482_write_register(client,
-					ADV7482_I2C_CP, 0x8C, 0x00);
-		ret = adv7482_write_register(client,
-					ADV7482_I2C_CP, 0x8B, 0x40);
-		ret = adv7482_write_register(client,
-					ADV7482_I2C_CP, 0x8D, 0x00);
-	}
-	ret = adv7482_write_register(client, ADV7482_I2C_IO,
-				ADV7482_IO_CP_VID_STD_REG, val);
-	return ret;
+		return ret;
+	}
+
+	ret = adv7482_set_cp_timing(state, custom);
+	if (ret < 0)
+		return ret;
+	ret = adv7482_write_register(state, ADV7482_I2C_CP,
+				ADV7482_CP_HSHIFT_CTRL_REG, hshift ? 0x43 : 0x40);
+	if (ret < 0)
+		return ret;
+	ret = adv7482_write_register(state, ADV7482_I2C_CP,
+				ADV7482_CP_HSHIFT_START_REG, hshift);
+	if (ret < 0)
+		return ret;
+	ret = adv7482_write_register(state, ADV7482_I2C_CP,
+				ADV7482_CP_HSHIFT_CTRL_REG, hshift ? 0x4F : 0x40);
+	if (ret < 0)
+		return ret;
+	ret = adv7482_write_register(state, ADV7482_I2C_CP,
+				ADV7482_CP_HSHIFT_END_REG, hshift);
+	if (ret < 0)
+		return ret;
+	ret = adv7482_update_bits(state, ADV7482_I2C_IO,
+				ADV7482_IO_CP_DATAPATH_REG,
+				ADV7482_IO_CP_V_FREQ_MASK,
+				v_freq << ADV7482_IO_CP_V_FREQ_SHIFT);
+	if (ret < 0)
+		return ret;
+	return adv7482_write_register(state, ADV7482_I2C_IO,
+				ADV7482_IO_CP_VID_STD_REG, vid_std);
 }
 /*****************************************************************************/
 /*  V4L2 decoder i/f handler for v4l2_subdev_core_ops                        */
@@ -1291,56 +1742,79 @@ static int adv7482_querystd(struct v4l2_subdev *sd, v4l2_std_id *std)
 {
 	struct adv7482_state *state = to_state(sd);
 	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
-	int err = mutex_lock_interruptible(&state->mutex);
+	int err = adv7482_wait_init(state);
 	if (err)
 		return err;
-	if (config->input == DECODER_INPUT_COMPOSITE)
-		/* when we are interrupt driven we know the state */
-		if (!state->autodetect)
-			*std = state->curr_norm;
-		else
-			err = __adv7482_status(state, NULL, std);
-	else
-		*std = V4L2_STD_ATSC;
+	err = mutex_lock_interruptible(&state->mutex);
+	if (err)
+		return err;
+	if (config->input != DECODER_INPUT_COMPOSITE)
+		*std = V4L2_STD_ATSC;
+	/* when we are interrupt driven we know the state */
+	else if (state->irq_active || !state->autodetect)
+		*std = state->curr_norm;
+	else {
+		state->fmt_valid = false;
+		err = __adv7482_status(state, NULL, std);
+	}
 	mutex_unlock(&state->mutex);
 	return err;
 }
 
+/*
+ * adv7482_s_dv_timings() - V4L2 decoder i/f handler for s_dv_timings
+ * @sd: pointer to standard V4L2 sub-device structure
+ * @timings: requested timings
+ *
+ * The CP follows the HDMI source, so only the timings of the current
+ * input are accepted. They are programmed the same way as on a stream
+ * start, other timings fail with -EINVAL.
+ */
 static int adv7482_s_dv_timings(struct v4l2_subdev *sd,
 				     struct v4l2_dv_timings *timings)
 {
-	int i;
-	printk("adv7482_s_dv_timings\n");
 	struct adv7482_state *state = to_state(sd);
+	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
+	struct v4l2_dv_timings measured;
+	int ret;
 
 	if (!timings)
 		return -EINVAL;
-	v4l2_print_dv_timings(sd->name, "adv7482_s_dv_timings: ",
+	if (debug)
+		v4l2_print_dv_timings(sd->name, "adv7482_s_dv_timings: ",
 			timings, false);
 
-	if (v4l2_match_dv_timings(&state->timings, timings, 0, false)) {
-		v4l2_dbg(1, debug, sd, "%s: no change\n", __func__);
-		return 0;
-	}
-
-
 	if (!v4l2_valid_dv_timings(timings, &adv7482_timings_cap, NULL, NULL)) {
 		v4l2_dbg(1, debug, sd, "%s: timings out of range\n", __func__);
 		return -ERANGE;
 	}
 
-	for (i = 0; i < ARRAY_SIZE(adv748x_hdmi_video_standards); i++) {
-		if (!v4l2_match_dv_timings(timings, &adv748x_hdmi_video_standards[i].timings, 250000,
-					   false))
-			continue;
+	ret = adv7482_wait_init(state);
+	if (ret)
+		return ret;
+	ret = mutex_lock_interruptible(&state->mutex);
+	if (ret)
+		return ret;
+	if (config->input == DECODER_INPUT_COMPOSITE) {
+		ret = -ENODATA;
+		goto out;
 	}
-
-	if (i >= ARRAY_SIZE(adv748x_hdmi_video_standards))
-		return -EINVAL;
-
-	state->timings = *timings;
-
-	return 0;
+	ret = adv7482_read_bt_timings(state, &measured);
+	if (ret < 0)
+		goto out;
+	if (!v4l2_match_dv_timings(timings, &measured,
+				   ADV7482_HDMI_PIXELCLOCK_TOL, false)) {
+		v4l2_dbg(1, debug, sd, "%s: input is %ux%u%c\n", __func__,
+			 measured.bt.width, measured.bt.height,
+			 measured.bt.interlaced ? 'i' : 'p');
+		ret = -EINVAL;
+		goto out;
+	}
+	/* Leaves a latched lane count alone, only the CP is written */
+	ret = adv7482_set_vid_info(sd);
+out:
+	mutex_unlock(&state->mutex);
+	return ret;
 }
 
 static int adv7482_g_dv_timings(struct v4l2_subdev *sd,
@@ -1357,22 +1831,38 @@ static int adv7482_g_dv_timings(struct v4l2_subdev *sd,
 static int adv7482_query_dv_timings(struct v4l2_subdev *sd,
 				     struct v4l2_dv_timings *timings)
 {
-	printk("adv7482_query_dv_timings\n");
-	u8 progressive;
-	u8 signal;
-	u32 width;
-	u32 height;
 	struct adv7482_state *state = to_state(sd);
+	const struct adv748x_hdmi_video_standards *std;
+	int ret;
+
 	if (!timings)
 		return -EINVAL;
+	ret = adv7482_wait_init(state);
+	if (ret)
+		return ret;
+	ret = mutex_lock_interruptible(&state->mutex);
+	if (ret)
+		return ret;
+	ret = adv7482_read_bt_timings(state, timings);
+	mutex_unlock(&state->mutex);
+	if (ret < 0) {
+		v4l2_dbg(1, debug, sd, "%s: no lock (%d)\n", __func__, ret);
+		return ret;
+	}
 	if (debug)
 		v4l2_print_dv_timings(sd->name, "adv7482_query_dv_timings: ",
 			timings, false);
+
+	/* Report the standard timings when the measurement is close enough */
+	std = adv7482_find_std(timings);
+	if (std) {
+		*timings = std->timings;
+		return 0;
+	}
 	if (!v4l2_valid_dv_timings(timings, &adv7482_timings_cap, NULL, NULL)) {
 		v4l2_dbg(1, debug, sd, "%s: timings out of range\n", __func__);
 		return -ERANGE;
 	}
-
 	return 0;
 }
 
@@ -1382,7 +1872,7 @@ static bool adv7482_check_dv_timings(const struct v4l2_dv_timings *timings,
 {
 	unsigned int i;
 
-	for (i = 0; adv748x_hdmi_video_standards[i].timings.bt.width; i++)
+	for (i = 0; i < ARRAY_SIZE(adv748x_hdmi_video_standards); i++)
 		if (v4l2_match_dv_timings(timings, &adv748x_hdmi_video_standards[i].timings, 0, false))
 			return true;
 
@@ -1413,18 +1903,30 @@ static int adv7482_dv_timings_cap(struct v4l2_subdev *sd,
  */
 static int adv7482_g_input_status(struct v4l2_subdev *sd, u32 *status)
 {
-	struct i2c_client *client = v4l2_get_subdevdata(sd);
 	struct adv7482_state *state = to_state(sd);
 	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
-	printk("adv7482_g_input_status(%x)\n",config->input_interface);
 	u8 status1 = 0;
-	int ret = mutex_lock_interruptible(&state->mutex);
+	int ret = adv7482_wait_init(state);
 	if (ret)
 		return ret;
-	if (config->input == DECODER_INPUT_COMPOSITE)
+	ret = mutex_lock_interruptible(&state->mutex);
+	if (ret)
+		return ret;
+	if (config->input == DECODER_INPUT_COMPOSITE && state->irq_active)
+		/* Kept up to date by the SDP interrupts */
+		*status = state->curr_norm == V4L2_STD_UNKNOWN ?
+				V4L2_IN_ST_NO_SIGNAL : 0;
+	else if (config->input == DECODER_INPUT_COMPOSITE) {
 		ret = __adv7482_status(state, status, NULL);
-	else {
-		ret = adv7482_read_register(client, ADV7482_I2C_HDMI,
+		if (ret < 0)
+			goto out;
+	} else if (state->irq_active) {
+		/* Kept up to date by the lock interrupts */
+		*status = state->hdmi_locked ? 0 : V4L2_IN_ST_NO_SIGNAL;
+	} else {
+		/* Without the lock interrupts this is the only change hint */
+		state->fmt_valid = false;
+		ret = adv7482_read_register(state, ADV7482_I2C_HDMI,
 				ADV7482_HDMI_STATUS1_REG, &status1);
 		if (ret < 0)
 			goto out;
@@ -1450,8 +1952,9 @@ static int adv7482_enum_mbus_code(struct v4l2_subdev *sd,
 
 	if (code->index != 0)
 		return -EINVAL;
+	/* The SDP sends CSI-2 YUV422 8-bit, which is UYVY byte order */
 	if (config->input == DECODER_INPUT_COMPOSITE)
-		code->code = MEDIA_BUS_FMT_YUYV8_2X8;
+		code->code = MEDIA_BUS_FMT_UYVY8_2X8;
 	else
 	{
 		if (code->index >= ARRAY_SIZE(media_bus_formats))
@@ -1463,152 +1966,482 @@ static int adv7482_enum_mbus_code(struct v4l2_subdev *sd,
 
 	return 0;
 }
-static int adv7482_mbus_fmt(struct v4l2_subdev *sd,
-			    struct v4l2_mbus_framefmt *fmt)
+/*
+ * adv7482_read_infoframe() - Read and unpack one received InfoFrame
+ * @state: pointer to private state structure
+ * @hdr_reg: InfoFrame map register holding the packet header
+ * @pb_reg: InfoFrame map register holding the checksum and payload
+ * @frame: unpacked InfoFrame
+ *
+ * The header and the payload are each read in one burst. The header
+ * holds only type, version and length, the checksum is PB0 and comes
+ * with the payload.
+ */
+static int adv7482_read_infoframe(struct adv7482_state *state, u8 hdr_reg,
+				  u8 pb_reg, union hdmi_infoframe *frame)
 {
-	printk("adv7482_mbus_fmt++");
-	struct adv7482_state *state = to_state(sd);
-	printk("code=%x, fmt=%x\n",fmt->code, fmt->colorspace);
+	u8 buf[HDMI_INFOFRAME_SIZE(AVI) + 4];
+	size_t len;
+	int ret;
+
+	ret = adv7482_read_block(state, ADV7482_I2C_INFOFRAME, hdr_reg,
+			buf, ADV7482_INFOFRAME_HDR_LEN);
+	if (ret < 0)
+		return ret;
+	len = buf[2] + 1;	/* checksum byte */
+	if (ADV7482_INFOFRAME_HDR_LEN + len > sizeof(buf))
+		return -EINVAL;
+	ret = adv7482_read_block(state, ADV7482_I2C_INFOFRAME, pb_reg,
+			buf + ADV7482_INFOFRAME_HDR_LEN, len);
+	if (ret < 0)
+		return ret;
+	ret = hdmi_infoframe_unpack(frame, buf,
+			ADV7482_INFOFRAME_HDR_LEN + len);
+	if (ret < 0)
+		v4l2_dbg(1, debug, &state->sd,
+			 "InfoFrame %02x not unpacked: %d (%*ph)\n", buf[0],
+			 ret, (int)(ADV7482_INFOFRAME_HDR_LEN + len), buf);
+	return ret;
+}
+/*
+ * adv7482_apply_csc() - Set up the CSC for the received colour space
+ * @state: pointer to private state structure
+ *
+ * The input colour space and range come from the AVI InfoFrame, falling
+ * back to automatic detection without one. The output range follows
+ * the quantization requested with set_fmt. The reported colorspace and
+ * encoding are updated in state->fmt. Called with state->mutex held.
+ */
+static int adv7482_apply_csc(struct adv7482_state *state)
+{
+	const struct hdmi_avi_infoframe *avi = &state->avi;
+	u8 inp = ADV7482_IO_INP_CS_AUTO;
+	bool full, bt709;
+	u8 val;
+
+	if (state->avi_valid) {
+		switch (avi->colorspace) {
+		case HDMI_COLORSPACE_RGB:
+			/* CE modes default to limited, IT modes to full */
+			if (avi->quantization_range ==
+					HDMI_QUANTIZATION_RANGE_DEFAULT)
+				full = avi->video_code == 0;
+			else
+				full = avi->quantization_range ==
+					HDMI_QUANTIZATION_RANGE_FULL;
+			inp = full ? ADV7482_IO_INP_CS_RGB_FULL :
+				     ADV7482_IO_INP_CS_RGB_LIM;
+			state->fmt.colorspace = V4L2_COLORSPACE_SRGB;
+			state->fmt.ycbcr_enc = V4L2_YCBCR_ENC_DEFAULT;
+			break;
+		case HDMI_COLORSPACE_YUV422:
+		case HDMI_COLORSPACE_YUV444:
+			if (avi->colorimetry == HDMI_COLORIMETRY_NONE)
+				bt709 = state->fmt.height >= 720;
+			else
+				bt709 = avi->colorimetry ==
+					HDMI_COLORIMETRY_ITU_709;
+			full = avi->ycc_quantization_range ==
+				HDMI_YCC_QUANTIZATION_RANGE_FULL;
+			if (bt709)
+				inp = full ? ADV7482_IO_INP_CS_YUV709_FULL :
+					     ADV7482_IO_INP_CS_YUV709;
+			else
+				inp = full ? ADV7482_IO_INP_CS_YUV601_FULL :
+					     ADV7482_IO_INP_CS_YUV601;
+			state->fmt.colorspace = bt709 ?
+				V4L2_COLORSPACE_REC709 :
+				V4L2_COLORSPACE_SMPTE170M;
+			state->fmt.ycbcr_enc = bt709 ? V4L2_YCBCR_ENC_709 :
+						       V4L2_YCBCR_ENC_601;
+			break;
+		default:
+			break;
+		}
+	}
+
+	val = inp << ADV7482_IO_INP_CS_SHIFT;
+	if (state->fmt.quantization == V4L2_QUANTIZATION_LIM_RANGE)
+		val |= ADV7482_IO_OP_RANGE_LIM;
+	return adv7482_update_bits(state, ADV7482_I2C_IO,
+			ADV7482_IO_CP_COLORSPACE_REG,
+			ADV7482_IO_INP_CS_MASK | ADV7482_IO_OP_RANGE_LIM, val);
+}
+/*
+ * adv7482_set_derep() - Remove repeated pixels in the HDMI receiver
+ * @state: pointer to private state structure
+ *
+ * Repetition removal is forced to the factor the source announces, so
+ * only unique pixels reach the CP and the CSI-2 transmitter. Deep colour
+ * needs nothing here: the CP output is always 8 bits per component.
+ */
+static int adv7482_set_derep(struct adv7482_state *state)
+{
+	u8 pol, st2;
+	int ret;
+
+	ret = adv7482_read_register(state, ADV7482_I2C_HDMI,
+			ADV7482_HDMI_POLARITY_REG, &pol);
+	if (ret < 0)
+		return ret;
+	ret = adv7482_read_register(state, ADV7482_I2C_HDMI,
+			ADV7482_HDMI_STATUS2_REG, &st2);
+	if (ret < 0)
+		return ret;
+	v4l2_dbg(1, debug, &state->sd, "pixel repetition %u, deep colour %u\n",
+		 ADV7482_HDMI_PIXEL_REP(pol),
+		 (st2 & ADV7482_HDMI_DCM_MASK) >> 6);
+	return adv7482_update_bits(state, ADV7482_I2C_HDMI,
+			ADV7482_HDMI_DEREP_REG,
+			ADV7482_HDMI_DEREP_OVERRIDE | ADV7482_HDMI_DEREP_N_MASK,
+			ADV7482_HDMI_DEREP_OVERRIDE |
+			(pol & ADV7482_HDMI_PIXEL_REP_MASK));
+}
+/*
+ * adv7482_update_infoframes() - Refresh the received InfoFrames
+ * @state: pointer to private state structure
+ *
+ * Re-reads the AVI and audio InfoFrames the source is sending and sets
+ * the CSC up for the new AVI InfoFrame. Called with state->mutex held.
+ */
+static int adv7482_update_infoframes(struct adv7482_state *state)
+{
+	union hdmi_infoframe frame;
+	u8 raw;
+	int ret;
+
+	ret = adv7482_read_register(state, ADV7482_I2C_IO,
+			ADV7482_IO_HDMI_LVL_RAW_REG, &raw);
+	if (ret < 0)
+		return ret;
+
+	state->avi_valid = false;
+	if ((raw & ADV7482_INT_AVI_INFO) &&
+	    !adv7482_read_infoframe(state, ADV7482_INFOFRAME_AVI_HDR_REG,
+				    ADV7482_INFOFRAME_AVI_PB_REG, &frame) &&
+	    frame.any.type == HDMI_INFOFRAME_TYPE_AVI) {
+		state->avi = frame.avi;
+		state->avi_valid = true;
+		v4l2_dbg(1, debug, &state->sd,
+			 "AVI: colorspace %d, range %d/%d, repeat %d\n",
+			 frame.avi.colorspace, frame.avi.quantization_range,
+			 frame.avi.ycc_quantization_range,
+			 frame.avi.pixel_repeat);
+	}
+
+	state->audio_if_valid = false;
+	if ((raw & ADV7482_INT_AUDIO_INFO) &&
+	    !adv7482_read_infoframe(state, ADV7482_INFOFRAME_AUDIO_HDR_REG,
+				    ADV7482_INFOFRAME_AUDIO_PB_REG, &frame) &&
+	    frame.any.type == HDMI_INFOFRAME_TYPE_AUDIO) {
+		state->audio_if = frame.audio;
+		state->audio_if_valid = true;
+		v4l2_dbg(1, debug, &state->sd,
+			 "Audio: %d channels, coding %d\n",
+			 frame.audio.channels, frame.audio.coding_type);
+	}
+
+	ret = adv7482_set_derep(state);
+	if (ret < 0)
+		return ret;
+	return adv7482_apply_csc(state);
+}
+
+/* Sample rates by IEC 60958 channel status sampling frequency code */
+static const unsigned int adv7482_audio_rates[16] = {
+	[0x0] = 44100,
+	[0x2] = 48000,
+	[0x3] = 32000,
+	[0x8] = 88200,
+	[0xA] = 96000,
+	[0xC] = 176400,
+	[0xE] = 192000,
+};
+
+/*
+ * adv7482_update_audio_rate() - Read the received audio sample rate
+ * @state: pointer to private state structure
+ *
+ * Takes the rate from the channel status the source sends along with
+ * the samples. The last known rate is kept when the source does not
+ * indicate one. A running capture is stopped on a change, it was set
+ * up for the old rate and would drift. Called with state->mutex held.
+ */
+static int adv7482_update_audio_rate(struct adv7482_state *state)
+{
+	struct snd_pcm_substream *sub = state->audio_sub;
+	unsigned long flags;
+	unsigned int rate;
+	u8 cs;
+	int ret;
+
+	ret = adv7482_read_register(state, ADV7482_I2C_HDMI,
+			ADV7482_HDMI_CS_DATA3_REG, &cs);
+	if (ret < 0)
+		return ret;
+	rate = adv7482_audio_rates[cs & ADV7482_HDMI_CS_FS_MASK];
+	if (rate && rate != state->audio_rate) {
+		v4l2_dbg(1, debug, &state->sd, "audio rate %u -> %u Hz\n",
+			 state->audio_rate, rate);
+		state->audio_rate = rate;
+		if (sub) {
+			snd_pcm_stream_lock_irqsave(sub, flags);
+			if (snd_pcm_running(sub))
+				snd_pcm_stop(sub, SNDRV_PCM_STATE_SETUP);
+			snd_pcm_stream_unlock_irqrestore(sub, flags);
+		}
+	}
+	return 0;
+}
+
+/*
+ * adv7482_audio_spf() - Audio samples per video frame
+ * @state: pointer to private state structure
+ * @spf: samples per frame in units of 1/65536 sample, 0 without a link
+ *
+ * HDMI audio is locked to the TMDS clock through N/CTS, with
+ * fs = f_tmds * N / (128 * CTS), and the frame rate follows from the
+ * same clock and the frame totals. The ratio is exact for the source's
+ * clocks, so the muxer can use it instead of estimating drift.
+ * state->timings holds the de-repeated mode, so its totals are scaled
+ * back to TMDS clocks by the pixel repetition factor.
+ * Called with state->mutex held.
+ */
+static int adv7482_audio_spf(struct adv7482_state *state, s32 *spf)
+{
+	const struct v4l2_bt_timings *bt = &state->timings.bt;
+	u8 acr[ADV7482_HDMI_ACR_LEN];
+	u8 pol, status2;
+	u32 cts, n, bpc;
+	u64 num;
+	int ret;
+
+	*spf = 0;
+	if (state->mipi_csi2_link[0].input != DECODER_INPUT_HDMI ||
+	    !V4L2_DV_BT_FRAME_WIDTH(bt) || !V4L2_DV_BT_FRAME_HEIGHT(bt))
+		return 0;
+	ret = adv7482_read_register(state, ADV7482_I2C_HDMI,
+			ADV7482_HDMI_POLARITY_REG, &pol);
+	if (ret < 0)
+		return ret;
+	ret = adv7482_read_register(state, ADV7482_I2C_HDMI,
+			ADV7482_HDMI_STATUS2_REG, &status2);
+	if (ret < 0)
+		return ret;
+	ret = adv7482_read_block(state, ADV7482_I2C_HDMI,
+			ADV7482_HDMI_ACR_REG, acr, sizeof(acr));
+	if (ret < 0)
+		return ret;
+	cts = (acr[0] << 12) | (acr[1] << 4) | (acr[2] >> 4);
+	n = ((acr[2] & 0x0F) << 16) | (acr[3] << 8) | acr[4];
+	if (!cts || !n)
+		return 0;
+
+	/* TMDS clocks per output pixel, in eighths */
+	switch ((status2 & ADV7482_HDMI_DCM_MASK) >> 6) {
+	case 1:
+		bpc = 10;
+		break;
+	case 2:
+		bpc = 12;
+		break;
+	default:
+		bpc = 8;
+		break;
+	}
+	num = (u64)n * V4L2_DV_BT_FRAME_WIDTH(bt) *
+		V4L2_DV_BT_FRAME_HEIGHT(bt) * bpc * ADV7482_HDMI_PIXEL_REP(pol);
+	*spf = min_t(u64, mul_u64_u64_div_u64(num, 1 << 16,
+					      (u64)8 * 128 * cts), S32_MAX);
+	return 0;
+}
+/*
+ * adv7482_detect_fmt() - Refresh the cached input format
+ * @state: pointer to private state structure
+ *
+ * Reads the lock status and frame size of the current input into
+ * state->fmt. Only called when the cache has been invalidated by a lock
+ * interrupt, a status re-query or a power up, so format queries normally
+ * cost no I2C traffic.
+ */
+static int adv7482_detect_fmt(struct adv7482_state *state)
+{
+	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
+	struct v4l2_mbus_framefmt *fmt = &state->fmt;
+	struct adv7482_sdp_main_info sdp_info;
+	u8 status_reg_10;
 	u8 progressive;
 	u8 signal;
 	u32 width;
 	u32 height;
 	int ret;
-	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
-	u8 status_reg_10;
-	struct adv7482_sdp_main_info sdp_info;
-	struct i2c_client *client = v4l2_get_subdevdata(sd);
+
 	if (config->input == DECODER_INPUT_COMPOSITE) {
-		ret = __adv7482_status(state, NULL, &state->curr_norm);
+		/* One status read gives both the standard and the locks */
+		ret = adv7482_read_sdp_main_info(state, &sdp_info);
 		if (ret < 0)
 			return ret;
-		fmt->code = MEDIA_BUS_FMT_YUYV8_2X8;
-		fmt->colorspace = V4L2_COLORSPACE_SMPTE170M;
+		status_reg_10 = sdp_info.status_reg_10;
+		state->curr_norm = adv7482_std_to_v4l2(status_reg_10);
 		fmt->width = 720;
 		fmt->height = state->curr_norm & V4L2_STD_525_60 ? 480 : 576;
-		/* Get video information */
-		ret = adv7482_read_sdp_main_info(client, &sdp_info);
-		if (ret < 0)
-			return ret;
-		status_reg_10 = sdp_info.status_reg_10;
-		
-		pr_info("%s info->status_reg_10 = 0x%02X = %d\n",__FUNCTION__,status_reg_10,(int)status_reg_10);
-		if ((int)status_reg_10 < 0){
-		 	dev_info(state->dev,
-		 		"Not detect any video input signal\n");
-		}
-		
-		else {
-			if ((status_reg_10 & ADV7482_SDP_R_REG_10_IN_LOCK) &&
-				(status_reg_10 & ADV7482_SDP_R_REG_10_FSC_LOCK)
-				&& (((status_reg_10 &
-				ADV7482_SDP_R_REG_10_AUTOD_PAL_M) ==
-				ADV7482_SDP_R_REG_10_AUTOD_PAL_M) ||
-				((status_reg_10 &
-				ADV7482_SDP_R_REG_10_AUTOD_PAL_60) ==
-				ADV7482_SDP_R_REG_10_AUTOD_PAL_60) ||
-				((status_reg_10 &
-				ADV7482_SDP_R_REG_10_AUTOD_PAL_B_G) ==
-				ADV7482_SDP_R_REG_10_AUTOD_PAL_B_G) ||
-				((status_reg_10 &
-				ADV7482_SDP_R_REG_10_AUTOD_PAL_COMB) ==
-				ADV7482_SDP_R_REG_10_AUTOD_PAL_COMB)))
-				dev_info(state->dev,
-				   "Detected the PAL video input signal\n");
-			else if ((status_reg_10 & ADV7482_SDP_R_REG_10_IN_LOCK)
-				&& (status_reg_10 &
-				ADV7482_SDP_R_REG_10_FSC_LOCK) &&
-				(((status_reg_10 &
-				ADV7482_SDP_R_REG_10_AUTOD_NTSC_4_43) ==
-				ADV7482_SDP_R_REG_10_AUTOD_NTSC_4_43) ||
-				((status_reg_10 &
-				ADV7482_SDP_R_REG_10_AUTOD_MASK) ==
-				ADV7482_SDP_R_REG_10_AUTOD_NTSM_M_J)))
-				dev_info(state->dev,
-				   "Detected the NTSC video input signal\n");
-			else{
-				dev_info(state->dev,
-				   "%d Not detect any video input signal\n",__LINE__);
-			}
-		}
-		state->width = fmt->width;
-		state->height = fmt->height;
-		state->field = V4L2_FIELD_INTERLACED;
-	} else {
-		if(fmt->code)
-		{
-			printk("Setting colour space\n");
-			switch(fmt->code)
-			{
-				case MEDIA_BUS_FMT_YUYV8_2X8:
-				case MEDIA_BUS_FMT_VYUY8_2X8:
-				case MEDIA_BUS_FMT_UYVY8_2X8:
-					printk("Using UYVY colour space\n");
-					fmt->colorspace = V4L2_COLORSPACE_SRGB;
-					ret = adv7482_write_registers(state->client,adv7482_init_txa_rgb);
-					break;
-				case MEDIA_BUS_FMT_YVYU8_2X8:
-				case MEDIA_BUS_FMT_YUYV8_1X16:
-				case MEDIA_BUS_FMT_VYUY8_1X16:
-				case MEDIA_BUS_FMT_UYVY8_1X16:
-				case MEDIA_BUS_FMT_YVYU8_1X16:
-					printk("Using YUV colour space\n");
-					fmt->colorspace = V4L2_COLORSPACE_REC709;
-					ret = adv7482_write_registers(state->client,adv7482_init_txa_yuv);
-					break;
-
-				case MEDIA_BUS_FMT_RGB888_1X32_PADHI:
-				case MEDIA_BUS_FMT_RGB888_1X24:
-					printk("Using RGB colour space\n");
-					fmt->colorspace = V4L2_COLORSPACE_SRGB;
-					ret = adv7482_write_registers(state->client,adv7482_init_txa_rgb);
-					break;
-
-				default:
-					printk("Unrecognised input: %x\n",fmt->code);
-					if (config->input_interface == DECODER_INPUT_INTERFACE_YCBCR422) {
-					fmt->code = MEDIA_BUS_FMT_UYVY8_2X8;
-					fmt->colorspace = V4L2_COLORSPACE_REC709 ;
-				} else {
-					fmt->code = MEDIA_BUS_FMT_RGB888_1X24;
-					fmt->colorspace = V4L2_COLORSPACE_SRGB;
-				}
-			}
-		}
+		fmt->field = V4L2_FIELD_INTERLACED;
+		if ((status_reg_10 & ADV7482_SDP_R_REG_10_IN_LOCK) &&
+			(status_reg_10 & ADV7482_SDP_R_REG_10_FSC_LOCK)
+			&& (((status_reg_10 &
+			ADV7482_SDP_R_REG_10_AUTOD_PAL_M) ==
+			ADV7482_SDP_R_REG_10_AUTOD_PAL_M) ||
+			((status_reg_10 &
+			ADV7482_SDP_R_REG_10_AUTOD_PAL_60) ==
+			ADV7482_SDP_R_REG_10_AUTOD_PAL_60) ||
+			((status_reg_10 &
+			ADV7482_SDP_R_REG_10_AUTOD_PAL_B_G) ==
+			ADV7482_SDP_R_REG_10_AUTOD_PAL_B_G) ||
+			((status_reg_10 &
+			ADV7482_SDP_R_REG_10_AUTOD_PAL_COMB) ==
+			ADV7482_SDP_R_REG_10_AUTOD_PAL_COMB)))
+			v4l2_dbg(1, debug, &state->sd,
+				 "Detected the PAL video input signal\n");
+		else if ((status_reg_10 & ADV7482_SDP_R_REG_10_IN_LOCK)
+			&& (status_reg_10 &
+			ADV7482_SDP_R_REG_10_FSC_LOCK) &&
+			(((status_reg_10 &
+			ADV7482_SDP_R_REG_10_AUTOD_NTSC_4_43) ==
+			ADV7482_SDP_R_REG_10_AUTOD_NTSC_4_43) ||
+			((status_reg_10 &
+			ADV7482_SDP_R_REG_10_AUTOD_MASK) ==
+			ADV7482_SDP_R_REG_10_AUTOD_NTSM_M_J)))
+			v4l2_dbg(1, debug, &state->sd,
+				 "Detected the NTSC video input signal\n");
 		else
-		{
-			if (config->input_interface == DECODER_INPUT_INTERFACE_YCBCR422) {
-				fmt->code = MEDIA_BUS_FMT_UYVY8_2X8;
-				fmt->colorspace = V4L2_COLORSPACE_REC709 ;
-			} else {
-				fmt->code = MEDIA_BUS_FMT_RGB888_1X24;
-				fmt->colorspace = V4L2_COLORSPACE_SRGB;
-			}
-		}
+			v4l2_dbg(1, debug, &state->sd,
+				 "Not detect any video input signal\n");
+	} else {
 		/* Get video information */
-		ret = adv7482_get_vid_info(sd, &progressive,
+		ret = adv7482_get_vid_info(&state->sd, &progressive,
 			&width, &height, &signal);
 		if (ret < 0) {
-			printk("adv7482_get_vid_info ret %d\n",ret);
-			width		= ADV7482_MAX_WIDTH;
-			height		= ADV7482_MAX_HEIGHT;
+			width		= ADV7482_FREE_RUN_WIDTH;
+			height		= ADV7482_FREE_RUN_HEIGHT;
 			progressive	= 1;
 		}
 		if (signal)
-			dev_info(state->dev,
-			 "Detected the HDMI video input signal (%dx%d%c)\n",
-			  width, height, (progressive) ? 'p' : 'i');
+			v4l2_dbg(1, debug, &state->sd,
+				 "Detected the HDMI video input signal (%dx%d%c)\n",
+				 width, height, (progressive) ? 'p' : 'i');
 		else
-			dev_info(state->dev,
-				"%d Not detect any video input signal\n",__LINE__);
-		state->width = width;
-		state->height = height;
-		state->field =
+			v4l2_dbg(1, debug, &state->sd,
+				 "Not detect any video input signal\n");
+		fmt->width = width;
+		fmt->height = height;
+		fmt->field =
 		      (progressive) ? V4L2_FIELD_NONE : V4L2_FIELD_INTERLACED;
-		fmt->width = state->width;
-		fmt->height = state->height;
+		if (signal)
+			adv7482_update_infoframes(state);
 	}
-	printk("adv7482_mbus_fmt(%d,%d)--",fmt->width,fmt->height);
+	state->fmt_valid = true;
+	return 0;
+}
+/*
+ * adv7482_set_csc() - Select the CP output colour space for a bus format
+ * @state: pointer to private state structure
+ * @fmt: requested format, code and colorspace are updated
+ *
+ * The output colour space registers are only written when the selection
+ * changes.
+ */
+static int adv7482_set_csc(struct adv7482_state *state,
+			   struct v4l2_mbus_framefmt *fmt)
+{
+	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
+	const struct adv7482_reg_value *csc;
+	int ret;
+
+	switch (fmt->code) {
+	case MEDIA_BUS_FMT_YUYV8_2X8:
+	case MEDIA_BUS_FMT_VYUY8_2X8:
+	case MEDIA_BUS_FMT_UYVY8_2X8:
+		fmt->colorspace = V4L2_COLORSPACE_SRGB;
+		csc = adv7482_init_txa_rgb;
+		break;
+	case MEDIA_BUS_FMT_YVYU8_2X8:
+	case MEDIA_BUS_FMT_YUYV8_1X16:
+	case MEDIA_BUS_FMT_VYUY8_1X16:
+	case MEDIA_BUS_FMT_UYVY8_1X16:
+	case MEDIA_BUS_FMT_YVYU8_1X16:
+		fmt->colorspace = V4L2_COLORSPACE_REC709;
+		csc = adv7482_init_txa_yuv;
+		break;
+	case MEDIA_BUS_FMT_RGB888_1X32_PADHI:
+	case MEDIA_BUS_FMT_RGB888_1X24:
+		fmt->colorspace = V4L2_COLORSPACE_SRGB;
+		csc = adv7482_init_txa_rgb;
+		break;
+	default:
+		/* Unrecognised or no code, report the default */
+		if (config->input_interface ==
+				DECODER_INPUT_INTERFACE_YCBCR422) {
+			fmt->code = MEDIA_BUS_FMT_UYVY8_2X8;
+			fmt->colorspace = V4L2_COLORSPACE_REC709;
+		} else {
+			fmt->code = MEDIA_BUS_FMT_RGB888_1X24;
+			fmt->colorspace = V4L2_COLORSPACE_SRGB;
+		}
+		return 0;
+	}
+
+	if (csc != state->csc) {
+		ret = adv7482_write_registers(state, csc);
+		if (ret < 0)
+			return ret;
+		state->csc = csc;
+	}
+	state->fmt.code = fmt->code;
+	state->fmt.colorspace = fmt->colorspace;
+	state->fmt.ycbcr_enc = V4L2_YCBCR_ENC_DEFAULT;
+	state->fmt.quantization =
+		fmt->quantization == V4L2_QUANTIZATION_LIM_RANGE ?
+		V4L2_QUANTIZATION_LIM_RANGE : V4L2_QUANTIZATION_FULL_RANGE;
+	ret = adv7482_apply_csc(state);
+	if (ret < 0)
+		return ret;
+	fmt->colorspace = state->fmt.colorspace;
+	fmt->ycbcr_enc = state->fmt.ycbcr_enc;
+	fmt->quantization = state->fmt.quantization;
+	return 0;
+}
+/*
+ * adv7482_mbus_fmt() - Apply a format and report the detected frame size
+ * @sd: pointer to standard V4L2 sub-device structure
+ * @fmt: pointer to the format to apply and fill in
+ *
+ * Called with state->mutex held.
+ */
+static int adv7482_mbus_fmt(struct v4l2_subdev *sd,
+			    struct v4l2_mbus_framefmt *fmt)
+{
+	struct adv7482_state *state = to_state(sd);
+	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
+	int ret;
+
+	if (!state->fmt_valid) {
+		ret = adv7482_detect_fmt(state);
+		if (ret < 0)
+			return ret;
+	}
+	if (config->input == DECODER_INPUT_COMPOSITE) {
+		fmt->code = MEDIA_BUS_FMT_UYVY8_2X8;
+		fmt->colorspace = V4L2_COLORSPACE_SMPTE170M;
+	} else {
+		ret = adv7482_set_csc(state, fmt);
+		if (ret < 0)
+			return ret;
+	}
+	state->width = state->fmt.width;
+	state->height = state->fmt.height;
+	state->field = state->fmt.field;
+	fmt->width = state->width;
+	fmt->height = state->height;
 	return 0;
 }
 /*
@@ -1630,9 +2463,12 @@ static int adv7482_cropcap(struct v4l2_subdev *sd, struct v4l2_cropcap *a)
 	a->bounds.left = 0;
 	a->bounds.top  = 0;
 	if (config->input == DECODER_INPUT_COMPOSITE) {
-		ret = __adv7482_status(state, NULL, &state->curr_norm);
-		if (ret < 0)
-			return ret;
+		/* curr_norm is kept current by the SDP interrupts */
+		if (!state->irq_active) {
+			ret = __adv7482_status(state, NULL, &state->curr_norm);
+			if (ret < 0)
+				return ret;
+		}
 		a->bounds.width  = 720;
 		a->bounds.height = state->curr_norm & V4L2_STD_525_60
 							 ? 480 : 576;
@@ -1674,9 +2510,12 @@ static int adv7482_g_crop(struct v4l2_subdev *sd, struct v4l2_crop *a)
 	a->c.left = 0;
 	a->c.top  = 0;
 	if (config->input == DECODER_INPUT_COMPOSITE) {
-		ret = __adv7482_status(state, NULL, &state->curr_norm);
-		if (ret < 0)
-			return ret;
+		/* curr_norm is kept current by the SDP interrupts */
+		if (!state->irq_active) {
+			ret = __adv7482_status(state, NULL, &state->curr_norm);
+			if (ret < 0)
+				return ret;
+		}
 		a->c.width  = 720;
 		a->c.height = state->curr_norm & V4L2_STD_525_60
 							 ? 480 : 576;
@@ -1696,50 +2535,123 @@ static int adv7482_g_crop(struct v4l2_subdev *sd, struct v4l2_crop *a)
 	return 0;
 }
 
-static int adv7482_set_power(struct adv7482_state *state, bool on)
+/* Per-lane bandwidth of the CSI-2 transmitters, in bits per second */
+#define ADV7482_CSI_TX_LANE_RATE	891000000ULL
+
+/*
+ * adv7482_txa_lanes() - Number of TXA data lanes needed for the current mode
+ * @state: pointer to private state structure
+ *
+ * Returns the fewest lanes (1, 2 or 4) that carry the current HDMI mode,
+ * or 4 when the pixel clock is not known.
+ */
+static unsigned int adv7482_txa_lanes(struct adv7482_state *state)
 {
-	u8 val;
-	int ret;
+	u64 bitrate = state->timings.bt.pixelclock * 24;
+	unsigned int lanes;
+
+	if (!bitrate)
+		return 4;
+
+	for (lanes = 1; lanes < 4; lanes <<= 1)
+		if (bitrate <= lanes * ADV7482_CSI_TX_LANE_RATE)
+			break;
+
+	return lanes;
+}
+
+/*
+ * adv7482_latch_mode() - Measure the HDMI mode and fix the TXA lane count
+ * @state: pointer to private state structure
+ *
+ * The receiver sizes its lanes from get_mbus_config before the stream is
+ * started, so the lane count is decided once here and both
+ * get_mbus_config and the TXA power up use it until the stream stops.
+ * Called with the mutex held.
+ */
+static int adv7482_latch_mode(struct adv7482_state *state)
+{
+	int ret;
+
+	ret = adv7482_set_vid_info(&state->sd);
+	if (ret < 0)
+		return ret;
+	state->txa_lanes = adv7482_txa_lanes(state);
+	return 0;
+}
+
+/*
+ * adv7482_write_tx_table() - Write a TX power table for a given lane count
+ * @state: pointer to private state structure
+ * @regs: TX power up or power down table
+ * @lanes: number of data lanes to enable
+ *
+ * The lane count lives in the low bits of TX register 0x00, which the
+ * tables write several times while sequencing the D-PHY.
+ */
+static int adv7482_write_tx_table(struct adv7482_state *state,
+				  const struct adv7482_reg_value *regs,
+				  unsigned int lanes)
+{
+	struct adv7482_reg_value tbl[16];
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(tbl); i++) {
+		tbl[i] = regs[i];
+		if ((tbl[i].addr == ADV7482_I2C_TXA ||
+		     tbl[i].addr == ADV7482_I2C_TXB) && tbl[i].reg == 0x00)
+			tbl[i].value = (tbl[i].value & ~0x07) | lanes;
+		if (tbl[i].addr == ADV7482_I2C_EOR)
+			return adv7482_write_registers(state, tbl);
+	}
+
+	return -EINVAL;
+}
+
+static int adv7482_set_power(struct adv7482_state *state, bool on)
+{
+	unsigned int lanes;
+	u8 val;
+	int ret;
 	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
-	
+
+	/* The input may have changed while the receiver was down */
+	if (on)
+		state->fmt_valid = false;
 	if (config->input == DECODER_INPUT_COMPOSITE) {
-		ret = adv7482_read_register(state->client, ADV7482_I2C_TXB,
-				0x1E, &val);
-		if (ret < 0)
-			return ret;
-		if (on && ((val & 0x40) == 0)) {
-			/* Power up */
-			ret = adv7482_write_registers(state->client,
-					adv7482_power_up_txb_1lane);
-			if (ret < 0)
-				goto fail;
-		} else {
-			/* Power down */
-			ret = adv7482_write_registers(state->client,
-					adv7482_power_down_txb_1lane);
+		/* The SDP goes out on TXA, see adv7482_route_input() */
+		lanes = 1;
+	} else {
+		/*
+		 * Keep the mode and lane count get_mbus_config reported, the
+		 * receiver is already set up for them. Stopping drops them so
+		 * that the next start measures again.
+		 */
+		if (on && !state->txa_lanes) {
+			ret = adv7482_latch_mode(state);
 			if (ret < 0)
-				goto fail;
+				return ret;
 		}
+		lanes = state->txa_lanes ?: adv7482_txa_lanes(state);
+		if (!on)
+			state->txa_lanes = 0;
+	}
+	ret = adv7482_read_register(state, ADV7482_I2C_TXA,
+			0x1E, &val);
+	if (ret < 0)
+		return ret;
+	if (on || config->input == DECODER_INPUT_HDMI) {
+		/* Power up */
+		ret = adv7482_write_tx_table(state,
+				adv7482_power_up_txa_4lane, lanes);
+		if (ret < 0)
+			goto fail;
 	} else {
-		/* set active resolution */
-		ret = adv7482_set_vid_info(&state->sd);
-		ret = adv7482_read_register(state->client, ADV7482_I2C_TXA,
-				0x1E, &val);
+		/* Power down */
+		ret = adv7482_write_registers(state,
+				adv7482_power_down_txa_4lane);
 		if (ret < 0)
-			return ret;
-		if (1) {
-			/* Power up */
-			ret = adv7482_write_registers(state->client,
-					adv7482_power_up_txa_4lane);
-			if (ret < 0)
-				goto fail;
-		} else {
-			/* Power down */
-			ret = adv7482_write_registers(state->client,
-					adv7482_power_down_txa_4lane);
-			if (ret < 0)
-				goto fail;
-		}
+			goto fail;
 	}
 	return 0;
 fail:
@@ -1750,6 +2662,9 @@ static int adv7482_s_power(struct v4l2_subdev *sd, int on)
 {
 	struct adv7482_state *state = to_state(sd);
 	int ret;
+	ret = adv7482_wait_init(state);
+	if (ret)
+		return ret;
 	ret = mutex_lock_interruptible(&state->mutex);
 	if (ret)
 		return ret;
@@ -1778,8 +2693,9 @@ static int adv7482_get_pad_format(struct v4l2_subdev *sd,
 				  struct v4l2_subdev_format *format)
 {
 	struct adv7482_state *state = to_state(sd);
+	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
+	int ret;
 
-	printk("which=%x, code=%x, fmt=%x\n",format->which, format->format.code, format->format.colorspace);
 	if ((format->which == V4L2_SUBDEV_FORMAT_TRY)&&cfg)
 	{
 	
@@ -1787,11 +2703,30 @@ static int adv7482_get_pad_format(struct v4l2_subdev *sd,
 		return 0;
 		
 	}
-	else {
-		adv7482_mbus_fmt(sd, &format->format);
-		format->format.field = state->field;
+	ret = adv7482_wait_init(state);
+	if (ret)
+		return ret;
+	ret = mutex_lock_interruptible(&state->mutex);
+	if (ret)
+		return ret;
+	if (!state->fmt_valid)
+		adv7482_detect_fmt(state);
+	state->width = state->fmt.width;
+	state->height = state->fmt.height;
+	state->field = state->fmt.field;
+	format->format.width = state->width;
+	format->format.height = state->height;
+	format->format.field = state->field;
+	if (config->input == DECODER_INPUT_COMPOSITE) {
+		format->format.code = MEDIA_BUS_FMT_UYVY8_2X8;
+		format->format.colorspace = V4L2_COLORSPACE_SMPTE170M;
+	} else {
+		format->format.code = state->fmt.code;
+		format->format.colorspace = state->fmt.colorspace;
+		format->format.ycbcr_enc = state->fmt.ycbcr_enc;
+		format->format.quantization = state->fmt.quantization;
 	}
-	printk("adv7482_get_pad_format--\n");
+	mutex_unlock(&state->mutex);
 	return 0;
 }
 static int adv7482_set_pad_format(struct v4l2_subdev *sd,
@@ -1801,74 +2736,255 @@ static int adv7482_set_pad_format(struct v4l2_subdev *sd,
 				  struct v4l2_subdev_format *format)
 {
 	struct adv7482_state *state = to_state(sd);
-	struct v4l2_mbus_framefmt *framefmt;
-	printk("adv7482_set_pad_format(%p,%p,%p)++\n",sd,cfg,format);
-	printk("which=%x, code=%x, fmt=%x\n",format->which, format->format.code, format->format.colorspace);
+	int ret;
+
+	ret = adv7482_wait_init(state);
+	if (ret)
+		return ret;
+	ret = mutex_lock_interruptible(&state->mutex);
+	if (ret)
+		return ret;
 
 	if (format->which == V4L2_SUBDEV_FORMAT_ACTIVE) {
-		framefmt = &format->format;
 		if (state->field != format->format.field) {
 			state->field = format->format.field;
 			adv7482_set_power(state, false);
 			adv7482_set_power(state, true);
 		}
+		ret = adv7482_mbus_fmt(sd, &format->format);
 	} else {
-		adv7482_mbus_fmt(sd, &format->format);
+		ret = adv7482_mbus_fmt(sd, &format->format);
 		if (format->format.field == V4L2_FIELD_ANY)
 			format->format.field = state->field;
-		return 0;
 	}
-	return adv7482_mbus_fmt(sd, framefmt);
+	mutex_unlock(&state->mutex);
+	return ret;
+}
+
+/*
+ * adv7482_notify_signal() - Tell the bridge whether HDMI frames are real
+ * @state: pointer to private state structure
+ *
+ * While the HDMI input is not locked the CP free-runs and TXA carries
+ * frames without content. The lock state is only tracked with the
+ * interrupts, so nothing is reported as missing without them.
+ */
+static void adv7482_notify_signal(struct adv7482_state *state)
+{
+	bool no_signal = state->irq_active && !state->hdmi_locked &&
+		state->mipi_csi2_link[0].input == DECODER_INPUT_HDMI;
+
+	v4l2_subdev_notify(&state->sd, ADV7482_NOTIFY_NO_SIGNAL, &no_signal);
 }
 
 static int adv7482_s_stream(struct v4l2_subdev *sd, int enable)
 {
 	struct adv7482_state *state = to_state(sd);
-	adv7482_set_power(state, enable);
+	int ret;
+
+	ret = adv7482_wait_init(state);
+	if (ret)
+		return ret;
+	/* Not interruptible, a stream stop has to go through */
+	mutex_lock(&state->mutex);
+	ret = adv7482_set_power(state, enable);
+	mutex_unlock(&state->mutex);
+	if (!ret && enable)
+		adv7482_notify_signal(state);
+	return ret;
+}
+
+static const struct v4l2_event adv7482_ev_source_change = {
+	.type = V4L2_EVENT_SOURCE_CHANGE,
+	.u.src_change.changes = V4L2_EVENT_SRC_CH_RESOLUTION,
+};
+
+/*
+ * adv7482_route_input() - Connect the selected input to TXA
+ * @state: pointer to private state structure
+ *
+ * Only TXA is linked to the CSI receiver, so the SDP output is switched
+ * onto it for CVBS instead of going out on TXB.
+ */
+static int adv7482_route_input(struct adv7482_state *state)
+{
+	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
+	u8 tx_en = ADV7482_IO_CSI4_EN;
+
+	if (config->input == DECODER_INPUT_COMPOSITE)
+		tx_en |= ADV7482_IO_CSI4_IN_SEL_AFE;
+	return adv7482_update_bits(state, ADV7482_I2C_IO, ADV7482_IO_TX_EN_REG,
+			ADV7482_IO_CSI4_EN | ADV7482_IO_CSI1_EN |
+			ADV7482_IO_CSI4_IN_SEL_AFE, tx_en);
+}
+
+/*
+ * adv7482_select_input() - Switch between the HDMI and CVBS paths
+ * @state: pointer to private state structure
+ * @input: path to select
+ *
+ * Both paths are programmed by the init work, so this only powers down
+ * TXA and switches its source. TXA is powered up again by the next
+ * s_stream. Called with the mutex held.
+ */
+static int adv7482_select_input(struct adv7482_state *state,
+				enum decoder_input input)
+{
+	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
+	int ret;
+
+	if (input == DECODER_INPUT_COMPOSITE ? !config->sdp_in :
+					       !config->hdmi_in)
+		return -EINVAL;
+	if (input == config->input)
+		return 0;
+	ret = adv7482_write_registers(state, config->power_down);
+	if (ret < 0)
+		return ret;
+	config->input = input;
+	state->fmt_valid = false;
+	state->txa_lanes = 0;
+	return adv7482_route_input(state);
+}
+
+/*
+ * adv7482_setup_picture_ctrls() - Write the picture controls again
+ * @state: pointer to private state structure
+ *
+ * Only the picture adjustments depend on the input. The EDID and free
+ * run controls are left alone, so a switch neither replaces an EDID set
+ * with S_EDID nor toggles the hot plug.
+ */
+static int adv7482_setup_picture_ctrls(struct adv7482_state *state)
+{
+	static const u32 cids[] = {
+		V4L2_CID_BRIGHTNESS,
+		V4L2_CID_CONTRAST,
+		V4L2_CID_SATURATION,
+		V4L2_CID_HUE,
+		V4L2_CID_TEST_PATTERN,
+	};
+	struct v4l2_ctrl *ctrl;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < ARRAY_SIZE(cids); i++) {
+		ctrl = v4l2_ctrl_find(&state->ctrl_hdl, cids[i]);
+		if (!ctrl)
+			continue;
+		v4l2_ctrl_lock(ctrl);
+		ret = adv7482_s_ctrl(ctrl);
+		v4l2_ctrl_unlock(ctrl);
+		if (ret < 0)
+			return ret;
+	}
+	return 0;
+}
+
+/*
+ * adv7482_s_routing() - V4L2 decoder i/f handler for s_routing
+ * @sd: pointer to standard V4L2 sub-device structure
+ * @input: ADV7482_ROUTE_HDMI or ADV7482_ROUTE_CVBS
+ * @output: unused
+ * @config: unused
+ *
+ * Switch the active input. The picture controls are written again
+ * afterwards since the CP and the SDP each have their own adjustments.
+ */
+static int adv7482_s_routing(struct v4l2_subdev *sd, u32 input, u32 output,
+			     u32 config)
+{
+	struct adv7482_state *state = to_state(sd);
+	struct adv7482_link_config *link = &state->mipi_csi2_link[0];
+	enum decoder_input old;
+	bool changed;
+	int ret;
+
+	ret = adv7482_wait_init(state);
+	if (ret)
+		return ret;
+	ret = mutex_lock_interruptible(&state->mutex);
+	if (ret)
+		return ret;
+	old = link->input;
+	switch (input) {
+	case ADV7482_ROUTE_HDMI:
+		ret = adv7482_select_input(state, DECODER_INPUT_HDMI);
+		break;
+	case ADV7482_ROUTE_CVBS:
+		ret = adv7482_select_input(state, DECODER_INPUT_COMPOSITE);
+		break;
+	default:
+		ret = -EINVAL;
+		break;
+	}
+	changed = link->input != old;
+	mutex_unlock(&state->mutex);
+	if (ret < 0 || !changed)
+		return ret;
+
+	ret = adv7482_setup_picture_ctrls(state);
+	if (ret < 0)
+		v4l2_dbg(1, debug, sd, "controls not applied: %d\n", ret);
+	adv7482_notify_signal(state);
+	v4l2_subdev_notify_event(sd, &adv7482_ev_source_change);
 	return 0;
 }
 
 /*
- * adv7482_g_mbus_config() - V4L2 decoder i/f handler for g_mbus_config
+ * adv7482_get_mbus_config() - V4L2 decoder i/f handler for get_mbus_config
  * @sd: pointer to standard V4L2 sub-device structure
+ * @pad: pad number
  * @cfg: pointer to V4L2 mbus_config structure
  *
- * Get mbus configuration.
+ * Get mbus configuration. CVBS always uses one lane, HDMI the fewest
+ * lanes that carry its mode. Outside of a stream the mode is
+ * measured again and its lane count latched for the following s_stream.
  */
-static int adv7482_g_mbus_config(struct v4l2_subdev *sd,
-					struct v4l2_mbus_config *cfg)
+static int adv7482_get_mbus_config(struct v4l2_subdev *sd, unsigned int pad,
+				   struct v4l2_mbus_config *cfg)
 {
 	struct adv7482_state *state = to_state(sd);
 	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
+	unsigned int i;
+	int ret;
+
+	ret = adv7482_wait_init(state);
+	if (ret)
+		return ret;
+	ret = mutex_lock_interruptible(&state->mutex);
+	if (ret)
+		return ret;
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->type = V4L2_MBUS_CSI2_DPHY;
+	/* Continuous clock */
+	cfg->bus.mipi_csi2.flags = 0;
 	if (config->input == DECODER_INPUT_COMPOSITE) {
-		cfg->bus.mipi_csi2.flags = V4L2_MBUS_CSI2_1_LANE |
-				V4L2_MBUS_CSI2_CHANNEL_0 |
-				V4L2_MBUS_CSI2_CONTINUOUS_CLOCK;
-	}
-	else
-	{
-		cfg->bus.mipi_csi2.flags = V4L2_MBUS_CSI2_LANES |
-				V4L2_MBUS_CSI2_CHANNELS |
-				V4L2_MBUS_CSI2_CONTINUOUS_CLOCK;
+		cfg->bus.mipi_csi2.num_data_lanes = 1;
+	} else {
+		if (!state->txa_lanes)
+			ret = adv7482_latch_mode(state);
+		cfg->bus.mipi_csi2.num_data_lanes = state->txa_lanes;
 	}
-	cfg->type = V4L2_MBUS_CSI1;
+	mutex_unlock(&state->mutex);
+	if (ret < 0)
+		return ret;
+	for (i = 0; i < cfg->bus.mipi_csi2.num_data_lanes; i++)
+		cfg->bus.mipi_csi2.data_lanes[i] = i + 1;
+
 	return 0;
 }
 /*****************************************************************************/
 /*  V4L2 decoder i/f handler for v4l2_ctrl_ops                               */
 /*****************************************************************************/
-static int adv7482_cp_s_ctrl(struct v4l2_ctrl *ctrl, struct i2c_client *client)
+static int adv7482_cp_s_ctrl(struct v4l2_ctrl *ctrl,
+			     struct adv7482_state *state)
 {
-	u8 val;
 	int ret;
 	/* Enable video adjustment first */
-	ret = adv7482_read_register(client, ADV7482_I2C_CP,
-			ADV7482_CP_VID_ADJ_REG, &val);
-	if (ret < 0)
-		return ret;
-	val |= ADV7482_CP_VID_ADJ_ENABLE;
-	ret = adv7482_write_register(client, ADV7482_I2C_CP,
-			ADV7482_CP_VID_ADJ_REG, val);
+	ret = adv7482_update_bits(state, ADV7482_I2C_CP,
+			ADV7482_CP_VID_ADJ_REG, ADV7482_CP_VID_ADJ_ENABLE,
+			ADV7482_CP_VID_ADJ_ENABLE);
 	if (ret < 0)
 		return ret;
 	switch (ctrl->id) {
@@ -1877,7 +2993,7 @@ static int adv7482_cp_s_ctrl(struct v4l2_ctrl *ctrl, struct i2c_client *client)
 					(ctrl->val > ADV7482_CP_BRI_MAX))
 			ret = -ERANGE;
 		else
-			ret = adv7482_write_register(client, ADV7482_I2C_CP,
+			ret = adv7482_write_register(state, ADV7482_I2C_CP,
 					ADV7482_CP_BRI_REG, ctrl->val);
 		break;
 	case V4L2_CID_HUE:
@@ -1885,7 +3001,7 @@ static int adv7482_cp_s_ctrl(struct v4l2_ctrl *ctrl, struct i2c_client *client)
 					(ctrl->val > ADV7482_CP_HUE_MAX))
 			ret = -ERANGE;
 		else
-			ret = adv7482_write_register(client, ADV7482_I2C_CP,
+			ret = adv7482_write_register(state, ADV7482_I2C_CP,
 					ADV7482_CP_HUE_REG, ctrl->val);
 		break;
 	case V4L2_CID_CONTRAST:
@@ -1893,7 +3009,7 @@ static int adv7482_cp_s_ctrl(struct v4l2_ctrl *ctrl, struct i2c_client *client)
 					(ctrl->val > ADV7482_CP_CON_MAX))
 			ret = -ERANGE;
 		else
-			ret = adv7482_write_register(client, ADV7482_I2C_CP,
+			ret = adv7482_write_register(state, ADV7482_I2C_CP,
 					ADV7482_CP_CON_REG, ctrl->val);
 		break;
 	case V4L2_CID_SATURATION:
@@ -1901,19 +3017,26 @@ static int adv7482_cp_s_ctrl(struct v4l2_ctrl *ctrl, struct i2c_client *client)
 					(ctrl->val > ADV7482_CP_SAT_MAX))
 			ret = -ERANGE;
 		else
-			ret = adv7482_write_register(client, ADV7482_I2C_CP,
+			ret = adv7482_write_register(state, ADV7482_I2C_CP,
 					ADV7482_CP_SAT_REG, ctrl->val);
 		break;
+	case V4L2_CID_TEST_PATTERN:
+		/* Without a source the CP free runs, so this works unplugged */
+		ret = adv7482_write_register(state, ADV7482_I2C_CP,
+				ADV7482_CP_PAT_GEN_REG, ctrl->val ?
+				ADV7482_CP_PAT_GEN_EN | (ctrl->val - 1) : 0);
+		break;
 	default:
 		ret = -EINVAL;
 	}
 	return ret;
 }
-static int adv7482_sdp_s_ctrl(struct v4l2_ctrl *ctrl, struct i2c_client *client)
+static int adv7482_sdp_s_ctrl(struct v4l2_ctrl *ctrl,
+			      struct adv7482_state *state)
 {
 	int ret;
-	ret = adv7482_write_register(client, ADV7482_I2C_SDP,
-			ADV7482_SDP_REG_CTRL, ADV7482_SDP_MAIN_MAP_RW);
+	ret = adv7482_update_bits(state, ADV7482_I2C_SDP,
+			ADV7482_SDP_REG_CTRL, 0xFF, ADV7482_SDP_MAIN_MAP_RW);
 	if (ret < 0)
 		return ret;
 	switch (ctrl->id) {
@@ -1922,7 +3045,7 @@ static int adv7482_sdp_s_ctrl(struct v4l2_ctrl *ctrl, struct i2c_client *client)
 					(ctrl->val > ADV7482_SDP_BRI_MAX))
 			ret = -ERANGE;
 		else
-			ret = adv7482_write_register(client, ADV7482_I2C_SDP,
+			ret = adv7482_write_register(state, ADV7482_I2C_SDP,
 					ADV7482_SDP_REG_BRI, ctrl->val);
 		break;
 	case V4L2_CID_HUE:
@@ -1931,7 +3054,7 @@ static int adv7482_sdp_s_ctrl(struct v4l2_ctrl *ctrl, struct i2c_client *client)
 			ret = -ERANGE;
 		else
 			/*Hue is inverted according to HSL chart */
-			ret = adv7482_write_register(client, ADV7482_I2C_SDP,
+			ret = adv7482_write_register(state, ADV7482_I2C_SDP,
 					ADV7482_SDP_REG_HUE, -ctrl->val);
 		break;
 	case V4L2_CID_CONTRAST:
@@ -1939,7 +3062,7 @@ static int adv7482_sdp_s_ctrl(struct v4l2_ctrl *ctrl, struct i2c_client *client)
 					(ctrl->val > ADV7482_SDP_CON_MAX))
 			ret = -ERANGE;
 		else
-			ret = adv7482_write_register(client, ADV7482_I2C_SDP,
+			ret = adv7482_write_register(state, ADV7482_I2C_SDP,
 					ADV7482_SDP_REG_CON, ctrl->val);
 		break;
 	case V4L2_CID_SATURATION:
@@ -1951,19 +3074,107 @@ static int adv7482_sdp_s_ctrl(struct v4l2_ctrl *ctrl, struct i2c_client *client)
 					(ctrl->val > ADV7482_SDP_SAT_MAX))
 			ret = -ERANGE;
 		else {
-			ret = adv7482_write_register(client, ADV7482_I2C_SDP,
+			ret = adv7482_write_register(state, ADV7482_I2C_SDP,
 					ADV7482_SDP_REG_SD_SAT_CB, ctrl->val);
 			if (ret < 0)
 				break;
-			ret = adv7482_write_register(client, ADV7482_I2C_SDP,
+			ret = adv7482_write_register(state, ADV7482_I2C_SDP,
 					ADV7482_SDP_REG_SD_SAT_CR, ctrl->val);
 		}
 		break;
+	case V4L2_CID_TEST_PATTERN:
+		/* The pattern is only sent in forced free run */
+		ret = adv7482_update_bits(state, ADV7482_I2C_SDP,
+				ADV7482_SDP_REG_DEF, ADV7482_SDP_DEF_VAL_EN,
+				ctrl->val ? ADV7482_SDP_DEF_VAL_EN : 0);
+		if (ret < 0 || !ctrl->val)
+			break;
+		ret = adv7482_update_bits(state, ADV7482_I2C_SDP,
+				ADV7482_SDP_REG_FRP, ADV7482_SDP_FRP_MASK,
+				ctrl->val - 1);
+		break;
 	default:
 		ret = -EINVAL;
 	}
 	return ret;
 }
+/*
+ * adv7482_write_edid() - Present state->edid on the HDMI port
+ * @state: pointer to private state structure
+ *
+ * Drops the hot plug, uploads the whole image in one burst and raises the
+ * hot plug again so the source re-reads it. With no blocks the EDID stays
+ * disabled and the hot plug low.
+ */
+static int adv7482_write_edid(struct adv7482_state *state)
+{
+	struct regmap *map = adv7482_regmap(state, ADV7482_I2C_EDID);
+	int ret;
+
+	ret = adv7482_write_registers(state, adv7482_edid_disable);
+	if (ret < 0)
+		return ret;
+	if (state->hpa) {
+		msleep(ADV7482_HPA_LOW_MS);
+		state->hpa = false;
+	}
+	if (!state->edid_blocks)
+		return 0;
+
+	ret = regmap_bulk_write(map, 0, state->edid,
+			state->edid_blocks * ADV7482_EDID_BLOCK_SIZE);
+	if (ret < 0)
+		return ret;
+	ret = adv7482_write_register(state, ADV7482_I2C_REPEATER,
+			ADV7482_RPT_EDID_SIZE_REG,
+			state->edid_blocks * ADV7482_EDID_BLOCK_SIZE / 16);
+	if (ret < 0)
+		return ret;
+	ret = adv7482_write_registers(state, adv7482_edid_enable);
+	if (ret < 0)
+		return ret;
+	state->hpa = true;
+	return 0;
+}
+/*
+ * adv7482_set_edid() - Replace the EDID presented on the HDMI port
+ * @state: pointer to private state structure
+ * @edid: new EDID image
+ * @blocks: number of 128 byte blocks in @edid
+ *
+ * Nothing is written when the image is unchanged. Called with
+ * state->mutex held.
+ */
+static int adv7482_set_edid(struct adv7482_state *state,
+			    const u8 *edid, unsigned int blocks)
+{
+	size_t len = blocks * ADV7482_EDID_BLOCK_SIZE;
+
+	if (blocks == state->edid_blocks && !memcmp(state->edid, edid, len))
+		return 0;
+	memcpy(state->edid, edid, len);
+	state->edid_blocks = blocks;
+	return adv7482_write_edid(state);
+}
+/*
+ * adv7482_set_free_run_color() - Set the colour sent while free running
+ * @state: pointer to private state structure
+ * @rgb: colour as 0xRRGGBB
+ *
+ * Only used when the manual free run colour is selected, otherwise the
+ * CP sends its default blue.
+ */
+static int adv7482_set_free_run_color(struct adv7482_state *state, u32 rgb)
+{
+	const struct adv7482_reg_value regs[] = {
+		{ADV7482_I2C_CP, ADV7482_CP_DEF_COL_A_REG, (rgb >> 16) & 0xFF},
+		{ADV7482_I2C_CP, ADV7482_CP_DEF_COL_B_REG, (rgb >> 8) & 0xFF},
+		{ADV7482_I2C_CP, ADV7482_CP_DEF_COL_C_REG, rgb & 0xFF},
+		{ADV7482_I2C_EOR, 0xFF, 0xFF}	/* End of register table */
+	};
+
+	return adv7482_write_registers(state, regs);
+}
 /*
  * adv7482_s_ctrl() - V4L2 decoder i/f handler for s_ctrl
  * @ctrl: pointer to standard V4L2 control structure
@@ -1974,34 +3185,318 @@ static int adv7482_s_ctrl(struct v4l2_ctrl *ctrl)
 {
 	struct v4l2_subdev *sd = to_adv7482_sd(ctrl);
 	struct adv7482_state *state = to_state(sd);
-	struct i2c_client *client = v4l2_get_subdevdata(sd);
-	int ret = mutex_lock_interruptible(&state->mutex);
 	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
+	int ret;
+
+	/* Read-only, updated from the interrupt handler */
+	if (ctrl->id == ADV7482_CID_AV_MUTE)
+		return 0;
+	/* Keeps the image from the last VIDIOC_S_EDID */
+	if (ctrl->id == ADV7482_CID_EDID_PRESET &&
+	    ctrl->val == ADV7482_EDID_CUSTOM)
+		return 0;
+	ret = adv7482_wait_init(state);
 	if (ret)
 		return ret;
-	if (config->input == DECODER_INPUT_COMPOSITE)
-		ret = adv7482_sdp_s_ctrl(ctrl, client);
+	ret = mutex_lock_interruptible(&state->mutex);
+	if (ret)
+		return ret;
+	if (ctrl->id == ADV7482_CID_EDID_PRESET)
+		ret = adv7482_set_edid(state,
+				adv7482_edid_presets[ctrl->val].edid,
+				adv7482_edid_presets[ctrl->val].blocks);
+	else if (ctrl->id == ADV7482_CID_FREE_RUN_COLOR_MANUAL)
+		ret = adv7482_update_bits(state, ADV7482_I2C_CP,
+				ADV7482_CP_DEF_COL_REG, ADV7482_CP_DEF_COL_MAN,
+				ctrl->val ? ADV7482_CP_DEF_COL_MAN : 0);
+	else if (ctrl->id == ADV7482_CID_FREE_RUN_COLOR)
+		ret = adv7482_set_free_run_color(state, ctrl->val);
+	else if (config->input == DECODER_INPUT_COMPOSITE)
+		ret = adv7482_sdp_s_ctrl(ctrl, state);
 	else
-		ret = adv7482_cp_s_ctrl(ctrl, client);
+		ret = adv7482_cp_s_ctrl(ctrl, state);
+	mutex_unlock(&state->mutex);
+	return ret;
+}
+
+/*
+ * adv7482_sdp_irq_enable - Unmask the SDP lock and autodetect interrupts
+ * @state: pointer to private state structure
+ *
+ * Also takes the current standard, later changes come from
+ * adv7482_sdp_handle_irq().
+ */
+static int adv7482_sdp_irq_enable(struct adv7482_state *state)
+{
+	int ret;
+
+	ret = adv7482_update_bits(state, ADV7482_I2C_SDP,
+			ADV7482_SDP_REG_CTRL, 0xFF, ADV7482_SDP_SUB_MAP1);
+	if (ret < 0)
+		return ret;
+	ret = adv7482_write_register(state, ADV7482_I2C_SDP,
+			ADV7482_SDP_INT_CLEAR3_REG, 0xFF);
+	if (ret < 0)
+		goto out;
+	ret = adv7482_write_register(state, ADV7482_I2C_SDP,
+			ADV7482_SDP_INT_MASK3_REG, ADV7482_SDP_INT_MASK);
+	if (ret < 0)
+		goto out;
+	ret = __adv7482_status(state, NULL, &state->curr_norm);
+out:
+	/* Other SDP accesses expect the main map */
+	adv7482_update_bits(state, ADV7482_I2C_SDP, ADV7482_SDP_REG_CTRL,
+			0xFF, ADV7482_SDP_MAIN_MAP_RW);
+	return ret;
+}
+
+/*
+ * adv7482_sdp_handle_irq - Acknowledge the SDP interrupts and refresh the
+ * detected standard
+ * @state: pointer to private state structure
+ *
+ * Returns 1 when something was pending, 0 when not, or a negative error
+ * code.
+ */
+static int adv7482_sdp_handle_irq(struct adv7482_state *state)
+{
+	v4l2_std_id std;
+	u8 sdp_st;
+	int ret;
+
+	mutex_lock(&state->mutex);
+	ret = adv7482_update_bits(state, ADV7482_I2C_SDP,
+			ADV7482_SDP_REG_CTRL, 0xFF, ADV7482_SDP_SUB_MAP1);
+	if (ret < 0)
+		goto out;
+	ret = adv7482_read_register(state, ADV7482_I2C_SDP,
+			ADV7482_SDP_INT_STATUS3_REG, &sdp_st);
+	if (ret < 0 || !(sdp_st & ADV7482_SDP_INT_MASK))
+		goto out;
+	adv7482_write_register(state, ADV7482_I2C_SDP,
+			ADV7482_SDP_INT_CLEAR3_REG, sdp_st);
+	ret = __adv7482_status(state, NULL, &std);
+	if (ret < 0)
+		goto out;
+	v4l2_dbg(1, debug, &state->sd, "sdp %02x, std %llx -> %llx\n",
+		 sdp_st, (unsigned long long)state->curr_norm,
+		 (unsigned long long)std);
+	state->curr_norm = std;
+	state->fmt_valid = false;
+	v4l2_subdev_notify_event(&state->sd, &adv7482_ev_source_change);
+	ret = 1;
+out:
+	/* Other SDP accesses expect the main map */
+	adv7482_update_bits(state, ADV7482_I2C_SDP, ADV7482_SDP_REG_CTRL,
+			0xFF, ADV7482_SDP_MAIN_MAP_RW);
 	mutex_unlock(&state->mutex);
 	return ret;
 }
 
+/*
+ * adv7482_irq_enable - Configure the interrupt pin and unmask the HDMI
+ * lock, AV mute and sample rate interrupts, and the SDP ones for CVBS
+ * @state: pointer to private state structure
+ *
+ * The interrupt registers are volatile and not restored by a cache sync,
+ * so this is run again on resume.
+ */
+static int adv7482_irq_enable(struct adv7482_state *state)
+{
+	u8 raw;
+	int ret;
+
+	ret = adv7482_write_register(state, ADV7482_I2C_IO,
+			ADV7482_IO_INT_CFG_REG, ADV7482_IO_INT_CFG_VAL);
+	if (ret < 0)
+		return ret;
+	/* Drop anything latched while the interrupts were masked */
+	ret = adv7482_write_register(state, ADV7482_I2C_IO,
+			ADV7482_IO_HDMI_LVL_CLR_REG, 0xFF);
+	if (ret < 0)
+		return ret;
+	ret = adv7482_write_register(state, ADV7482_I2C_IO,
+			ADV7482_IO_HDMI_LOCK_CLR_REG, 0xFF);
+	if (ret < 0)
+		return ret;
+	ret = adv7482_write_register(state, ADV7482_I2C_IO,
+			ADV7482_IO_HDMI_EDGE_CLR_REG, 0xFF);
+	if (ret < 0)
+		return ret;
+
+	ret = adv7482_read_register(state, ADV7482_I2C_IO,
+			ADV7482_IO_HDMI_LOCK_RAW_REG, &raw);
+	if (ret < 0)
+		return ret;
+	state->hdmi_locked = (raw & ADV7482_INT_LOCK_MASK) ==
+				ADV7482_INT_LOCK_MASK;
+	/* Later changes come with the new sample rate interrupt */
+	ret = adv7482_update_audio_rate(state);
+	if (ret < 0)
+		return ret;
+
+	ret = adv7482_write_register(state, ADV7482_I2C_IO,
+			ADV7482_IO_HDMI_LVL_MASK_REG, ADV7482_INT_LVL_MASK);
+	if (ret < 0)
+		return ret;
+	ret = adv7482_write_register(state, ADV7482_I2C_IO,
+			ADV7482_IO_HDMI_LOCK_MASK_REG, ADV7482_INT_LOCK_MASK);
+	if (ret < 0)
+		return ret;
+	ret = adv7482_write_register(state, ADV7482_I2C_IO,
+			ADV7482_IO_HDMI_EDGE_MASK_REG, ADV7482_INT_NEW_SAMP_RT);
+	if (ret < 0)
+		return ret;
+	if (state->mipi_csi2_link[0].sdp_in)
+		return adv7482_sdp_irq_enable(state);
+	return 0;
+}
+
+/*
+ * adv7482_handle_irq - Decode and acknowledge the pending HDMI and SDP
+ * interrupts
+ * @state: pointer to private state structure
+ *
+ * Returns the number of interrupt banks that had something pending, or a
+ * negative error code.
+ */
+static int adv7482_handle_irq(struct adv7482_state *state)
+{
+	u8 lvl_st, lock_st, edge_st, raw;
+	int handled = 0;
+	int ret;
+
+	ret = adv7482_read_register(state, ADV7482_I2C_IO,
+			ADV7482_IO_HDMI_LOCK_ST_REG, &lock_st);
+	if (ret < 0)
+		return ret;
+	if (lock_st) {
+		ret = adv7482_read_register(state, ADV7482_I2C_IO,
+				ADV7482_IO_HDMI_LOCK_RAW_REG, &raw);
+		if (ret < 0)
+			return ret;
+		adv7482_write_register(state, ADV7482_I2C_IO,
+				ADV7482_IO_HDMI_LOCK_CLR_REG, lock_st);
+		/* Ordered against the format detection setting fmt_valid */
+		mutex_lock(&state->mutex);
+		state->hdmi_locked = (raw & ADV7482_INT_LOCK_MASK) ==
+					ADV7482_INT_LOCK_MASK;
+		/*
+		 * txa_lanes stays latched, the receiver may already be set up
+		 * for it. The stream stop drops it.
+		 */
+		state->fmt_valid = false;
+		mutex_unlock(&state->mutex);
+		v4l2_dbg(1, debug, &state->sd, "lock %02x, raw %02x\n",
+			 lock_st, raw);
+		/*
+		 * A new lock means a new mode, a lost one means no signal.
+		 * The CP free runs at the programmed standard meanwhile, so
+		 * the stream keeps going and the bridge flags its frames.
+		 */
+		adv7482_notify_signal(state);
+		v4l2_subdev_notify_event(&state->sd,
+					 &adv7482_ev_source_change);
+		handled++;
+	}
+
+	ret = adv7482_read_register(state, ADV7482_I2C_IO,
+			ADV7482_IO_HDMI_LVL_ST_REG, &lvl_st);
+	if (ret < 0)
+		return ret;
+	if (lvl_st) {
+		ret = adv7482_read_register(state, ADV7482_I2C_IO,
+				ADV7482_IO_HDMI_LVL_RAW_REG, &raw);
+		if (ret < 0)
+			return ret;
+		adv7482_write_register(state, ADV7482_I2C_IO,
+				ADV7482_IO_HDMI_LVL_CLR_REG, lvl_st);
+		if (lvl_st & ADV7482_INT_AV_MUTE)
+			v4l2_ctrl_s_ctrl(state->av_mute_ctrl,
+					 !!(raw & ADV7482_INT_AV_MUTE));
+		handled++;
+	}
+	if (lock_st || (lvl_st & (ADV7482_INT_AVI_INFO |
+				  ADV7482_INT_AUDIO_INFO))) {
+		mutex_lock(&state->mutex);
+		adv7482_update_infoframes(state);
+		mutex_unlock(&state->mutex);
+	}
+
+	ret = adv7482_read_register(state, ADV7482_I2C_IO,
+			ADV7482_IO_HDMI_EDGE_ST_REG, &edge_st);
+	if (ret < 0)
+		return ret;
+	if (edge_st) {
+		adv7482_write_register(state, ADV7482_I2C_IO,
+				ADV7482_IO_HDMI_EDGE_CLR_REG, edge_st);
+		if (edge_st & ADV7482_INT_NEW_SAMP_RT) {
+			mutex_lock(&state->mutex);
+			adv7482_update_audio_rate(state);
+			mutex_unlock(&state->mutex);
+		}
+		handled++;
+	}
+	if (state->mipi_csi2_link[0].sdp_in) {
+		ret = adv7482_sdp_handle_irq(state);
+		if (ret < 0)
+			return ret;
+		handled += ret;
+	}
+	return handled;
+}
+
+static irqreturn_t adv7482_irq_thread(int irq, void *dev_id)
+{
+	struct adv7482_state *state = dev_id;
+
+	return adv7482_handle_irq(state) > 0 ? IRQ_HANDLED : IRQ_NONE;
+}
+
 static int adv7482_isr(struct v4l2_subdev *sd, u32 status, bool *handled)
 {
 	struct adv7482_state *state = to_state(sd);
 	int ret;
-	u8 val;
-	printk("adv7482_isr++\n");
-	ret = adv7482_read_register(state->client, ADV7482_I2C_IO,
-			0x8A, &val);
-	if(val&2)
-	{
-		printk("New frequency\n");
-	}
+
+	ret = adv7482_handle_irq(state);
 	if (handled)
-		*handled = true;
-	return ret;
+		*handled = ret > 0;
+	return ret < 0 ? ret : 0;
+}
+
+static long adv7482_ioctl(struct v4l2_subdev *sd, unsigned int cmd, void *arg)
+{
+	struct adv7482_state *state = to_state(sd);
+	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
+	u32 *route = arg;
+	int ret;
+
+	switch (cmd) {
+	case ADV7482_G_ROUTING:
+		ret = mutex_lock_interruptible(&state->mutex);
+		if (ret)
+			return ret;
+		*route = config->input == DECODER_INPUT_COMPOSITE ?
+			 ADV7482_ROUTE_CVBS : ADV7482_ROUTE_HDMI;
+		mutex_unlock(&state->mutex);
+		return 0;
+	default:
+		return -ENOIOCTLCMD;
+	}
+}
+
+static int adv7482_subscribe_event(struct v4l2_subdev *sd,
+				   struct v4l2_fh *fh,
+				   struct v4l2_event_subscription *sub)
+{
+	switch (sub->type) {
+	case V4L2_EVENT_SOURCE_CHANGE:
+		return v4l2_src_change_event_subdev_subscribe(sd, fh, sub);
+	case V4L2_EVENT_CTRL:
+		return v4l2_ctrl_subdev_subscribe_event(sd, fh, sub);
+	default:
+		return -EINVAL;
+	}
 }
 
 static const struct v4l2_subdev_core_ops adv7482_core_ops = {
@@ -2015,23 +3510,175 @@ static const struct v4l2_subdev_core_ops adv7482_core_ops = {
 	.querymenu = v4l2_subdev_querymenu,
 #endif
 	.interrupt_service_routine = adv7482_isr,
+	.subscribe_event = adv7482_subscribe_event,
+	.unsubscribe_event = v4l2_event_subdev_unsubscribe,
 	.s_power = adv7482_s_power,
+	.ioctl = adv7482_ioctl,
 };
+/*
+ * adv7482_hdmi_frame_interval() - Frame interval of the HDMI input
+ * @state: pointer to private state structure
+ * @interval: filled with the time per frame
+ *
+ * Uses the frame totals and pixel clock of the matching standard. The
+ * measured pixel clock tells a 1000/1001 source (59.94 Hz) from the
+ * nominal one, the standards table tolerance covers both. Unknown modes
+ * get the measured values. Called with state->mutex held.
+ */
+static int adv7482_hdmi_frame_interval(struct adv7482_state *state,
+				       struct v4l2_fract *interval)
+{
+	const struct adv748x_hdmi_video_standards *std;
+	const struct v4l2_bt_timings *bt;
+	struct v4l2_dv_timings timings;
+	u32 measured, pixelclock, total, g;
+	int ret;
+
+	ret = adv7482_read_bt_timings(state, &timings);
+	if (ret < 0)
+		return ret;
+	measured = timings.bt.pixelclock;
+	std = adv7482_find_std(&timings);
+	bt = std ? &std->timings.bt : &timings.bt;
+	pixelclock = bt->pixelclock;
+	total = V4L2_DV_BT_FRAME_WIDTH(bt) * V4L2_DV_BT_FRAME_HEIGHT(bt);
+	if (!pixelclock || !total)
+		return -ENOLINK;
+
+	g = gcd(total, pixelclock);
+	interval->numerator = total / g;
+	interval->denominator = pixelclock / g;
+	/* The reduced rate clock is 1000 ppm below the nominal one */
+	if (std && measured < pixelclock - pixelclock / 2002 &&
+	    interval->denominator <= U32_MAX / 1000) {
+		interval->numerator *= 1001;
+		interval->denominator *= 1000;
+		g = gcd(interval->numerator, interval->denominator);
+		interval->numerator /= g;
+		interval->denominator /= g;
+	}
+	return 0;
+}
+
+/*
+ * adv7482_g_frame_interval() - V4L2 decoder i/f handler for g_frame_interval
+ * @sd: pointer to standard V4L2 sub-device structure
+ * @fi: pointer to the frame interval structure
+ *
+ * Report the time per frame of the current input.
+ */
+static int adv7482_g_frame_interval(struct v4l2_subdev *sd,
+				    struct v4l2_subdev_frame_interval *fi)
+{
+	struct adv7482_state *state = to_state(sd);
+	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
+	int ret;
+
+	if (fi->pad != 0)
+		return -EINVAL;
+	ret = adv7482_wait_init(state);
+	if (ret)
+		return ret;
+	ret = mutex_lock_interruptible(&state->mutex);
+	if (ret)
+		return ret;
+	if (config->input == DECODER_INPUT_COMPOSITE) {
+		/* curr_norm is kept current by the SDP interrupts */
+		if (!state->irq_active)
+			ret = __adv7482_status(state, NULL, &state->curr_norm);
+		if (state->curr_norm & V4L2_STD_525_60) {
+			fi->interval.numerator = 1001;
+			fi->interval.denominator = 30000;
+		} else {
+			fi->interval.numerator = 1;
+			fi->interval.denominator = 25;
+		}
+	} else {
+		ret = adv7482_hdmi_frame_interval(state, &fi->interval);
+	}
+	mutex_unlock(&state->mutex);
+	v4l2_dbg(2, debug, sd, "frame interval %u/%u (%d)\n",
+		 fi->interval.numerator, fi->interval.denominator, ret);
+	return ret;
+}
 static const struct v4l2_subdev_video_ops adv7482_video_ops = {
 	.querystd	= adv7482_querystd,
 	.s_dv_timings = adv7482_s_dv_timings,
 	.g_dv_timings = adv7482_g_dv_timings,
 	.query_dv_timings = adv7482_query_dv_timings,
 	.g_input_status = adv7482_g_input_status,
+	.s_routing = adv7482_s_routing,
+	.g_frame_interval = adv7482_g_frame_interval,
 	//.cropcap	= adv7482_cropcap,
 	//.g_crop		= adv7482_g_crop,
-	//.g_mbus_config	= adv7482_g_mbus_config, 
 	.s_stream = adv7482_s_stream,
 };
+static int adv7482_get_edid(struct v4l2_subdev *sd, struct v4l2_edid *edid)
+{
+	struct adv7482_state *state = to_state(sd);
+	int ret;
+
+	memset(edid->reserved, 0, sizeof(edid->reserved));
+	if (edid->pad != 0)
+		return -EINVAL;
+	ret = mutex_lock_interruptible(&state->mutex);
+	if (ret)
+		return ret;
+	if (edid->start_block == 0 && edid->blocks == 0) {
+		edid->blocks = state->edid_blocks;
+		goto out;
+	}
+	if (state->edid_blocks == 0) {
+		ret = -ENODATA;
+		goto out;
+	}
+	if (edid->start_block >= state->edid_blocks) {
+		ret = -EINVAL;
+		goto out;
+	}
+	if (edid->start_block + edid->blocks > state->edid_blocks)
+		edid->blocks = state->edid_blocks - edid->start_block;
+	memcpy(edid->edid,
+	       state->edid + edid->start_block * ADV7482_EDID_BLOCK_SIZE,
+	       edid->blocks * ADV7482_EDID_BLOCK_SIZE);
+out:
+	mutex_unlock(&state->mutex);
+	return ret;
+}
+
+static int adv7482_set_edid_op(struct v4l2_subdev *sd, struct v4l2_edid *edid)
+{
+	struct adv7482_state *state = to_state(sd);
+	int ret;
+
+	memset(edid->reserved, 0, sizeof(edid->reserved));
+	if (edid->pad != 0 || edid->start_block != 0)
+		return -EINVAL;
+	if (edid->blocks > ADV7482_EDID_MAX_BLOCKS) {
+		edid->blocks = ADV7482_EDID_MAX_BLOCKS;
+		return -E2BIG;
+	}
+	ret = adv7482_wait_init(state);
+	if (ret)
+		return ret;
+	ret = mutex_lock_interruptible(&state->mutex);
+	if (ret)
+		return ret;
+	ret = adv7482_set_edid(state, edid->edid, edid->blocks);
+	mutex_unlock(&state->mutex);
+	if (ret < 0)
+		return ret;
+	/* A later handler setup must not bring the preset back */
+	return v4l2_ctrl_s_ctrl(state->edid_preset_ctrl, ADV7482_EDID_CUSTOM);
+}
+
 static const struct v4l2_subdev_pad_ops adv7482_pad_ops = {
 	.enum_mbus_code = adv7482_enum_mbus_code,
+	.get_edid = adv7482_get_edid,
+	.set_edid = adv7482_set_edid_op,
 	.set_fmt = adv7482_set_pad_format,
 	.get_fmt = adv7482_get_pad_format,
+	.get_mbus_config = adv7482_get_mbus_config,
 	//.enum_frame_size = adv7482_enum_framesizes,
 	//.dv_timings_cap = adv7482_dv_timings_cap,
 	//.enum_dv_timings = adv7482_enum_dv_timings,
@@ -2041,18 +3688,115 @@ static const struct v4l2_subdev_ops adv7482_ops = {
 	.video = &adv7482_video_ops,
 	.pad = &adv7482_pad_ops,
 };
-static const struct v4l2_ctrl_ops adv7482_ctrl_ops = {
-	.s_ctrl = adv7482_s_ctrl,
+static int adv7482_g_volatile_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct v4l2_subdev *sd = to_adv7482_sd(ctrl);
+	struct adv7482_state *state = to_state(sd);
+	int ret;
+
+	if (ctrl->id != ADV7482_CID_AUDIO_SPF)
+		return 0;
+	ret = adv7482_wait_init(state);
+	if (ret)
+		return ret;
+	ret = mutex_lock_interruptible(&state->mutex);
+	if (ret)
+		return ret;
+	ret = adv7482_audio_spf(state, &ctrl->val);
+	mutex_unlock(&state->mutex);
+	return ret;
+}
+static const struct v4l2_ctrl_ops adv7482_ctrl_ops = {
+	.g_volatile_ctrl = adv7482_g_volatile_ctrl,
+	.s_ctrl = adv7482_s_ctrl,
+};
+static const struct v4l2_ctrl_config adv7482_ctrl_av_mute = {
+	.ops = &adv7482_ctrl_ops,
+	.id = ADV7482_CID_AV_MUTE,
+	.name = "AV Mute",
+	.type = V4L2_CTRL_TYPE_BOOLEAN,
+	.max = 1,
+	.step = 1,
+	.flags = V4L2_CTRL_FLAG_READ_ONLY,
+};
+static const struct v4l2_ctrl_config adv7482_ctrl_edid_preset = {
+	.ops = &adv7482_ctrl_ops,
+	.id = ADV7482_CID_EDID_PRESET,
+	.name = "EDID Preset",
+	.type = V4L2_CTRL_TYPE_MENU,
+	.max = ADV7482_EDID_CUSTOM,
+	.qmenu = adv7482_edid_preset_names,
+};
+static const struct v4l2_ctrl_config adv7482_ctrl_free_run_color_manual = {
+	.ops = &adv7482_ctrl_ops,
+	.id = ADV7482_CID_FREE_RUN_COLOR_MANUAL,
+	.name = "Free Running Color, Manual",
+	.type = V4L2_CTRL_TYPE_BOOLEAN,
+	.max = 1,
+	.step = 1,
+};
+static const struct v4l2_ctrl_config adv7482_ctrl_free_run_color = {
+	.ops = &adv7482_ctrl_ops,
+	.id = ADV7482_CID_FREE_RUN_COLOR,
+	.name = "Free Running Color",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.max = 0xFFFFFF,
+	.step = 1,
+};
+static const struct v4l2_ctrl_config adv7482_ctrl_audio_spf = {
+	.ops = &adv7482_ctrl_ops,
+	.id = ADV7482_CID_AUDIO_SPF,
+	.name = "Audio Samples per Frame",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.max = S32_MAX,
+	.step = 1,
+	.flags = V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE,
+};
+
+/*
+ * Patterns both the CP and the SDP generate, in the order of their
+ * pattern select values
+ */
+static const char * const adv7482_test_pattern_menu[] = {
+	"Disabled",
+	"Solid Color",
+	"Color Bars",
+	"Grey Ramp",
 };
+
+/*
+ * adv7482_hdmi_init_controls() - Add the HDMI receiver controls
+ * @state: pointer to private state structure
+ *
+ * The HDMI path is set up whatever the starting input, so these are
+ * present with both the CP and the SDP picture controls.
+ */
+static void adv7482_hdmi_init_controls(struct adv7482_state *state)
+{
+	struct v4l2_ctrl_config edid_cfg = adv7482_ctrl_edid_preset;
+
+	state->av_mute_ctrl = v4l2_ctrl_new_custom(&state->ctrl_hdl,
+						   &adv7482_ctrl_av_mute, NULL);
+	edid_cfg.def = min_t(unsigned int, edid_preset,
+			     ADV7482_EDID_CUSTOM - 1);
+	state->edid_preset_ctrl = v4l2_ctrl_new_custom(&state->ctrl_hdl,
+						       &edid_cfg, NULL);
+	v4l2_ctrl_new_custom(&state->ctrl_hdl, &adv7482_ctrl_audio_spf, NULL);
+	v4l2_ctrl_new_custom(&state->ctrl_hdl,
+			     &adv7482_ctrl_free_run_color_manual, NULL);
+	v4l2_ctrl_new_custom(&state->ctrl_hdl,
+			     &adv7482_ctrl_free_run_color, NULL);
+}
 /*
  * adv7482_init_controls() - Init controls
  * @state: pointer to private state structure
  *
- * Init ADV7482 supported control handler.
+ * Init ADV7482 supported control handler. The values are written to the
+ * chip once the init work has run.
  */
 static int adv7482_cp_init_controls(struct adv7482_state *state)
 {
-	v4l2_ctrl_handler_init(&state->ctrl_hdl, 4);
+	v4l2_ctrl_handler_init(&state->ctrl_hdl, 10);
 	v4l2_ctrl_new_std(&state->ctrl_hdl, &adv7482_ctrl_ops,
 			  V4L2_CID_BRIGHTNESS, ADV7482_CP_BRI_MIN,
 			  ADV7482_CP_BRI_MAX, 1, ADV7482_CP_BRI_DEF);
@@ -2065,19 +3809,22 @@ static int adv7482_cp_init_controls(struct adv7482_state *state)
 	v4l2_ctrl_new_std(&state->ctrl_hdl, &adv7482_ctrl_ops,
 			  V4L2_CID_HUE, ADV7482_CP_HUE_MIN,
 			  ADV7482_CP_HUE_MAX, 1, ADV7482_CP_HUE_DEF);
+	v4l2_ctrl_new_std_menu_items(&state->ctrl_hdl, &adv7482_ctrl_ops,
+			V4L2_CID_TEST_PATTERN,
+			ARRAY_SIZE(adv7482_test_pattern_menu) - 1, 0, 0,
+			adv7482_test_pattern_menu);
+	adv7482_hdmi_init_controls(state);
 	state->sd.ctrl_handler = &state->ctrl_hdl;
 	if (state->ctrl_hdl.error) {
 		int err = state->ctrl_hdl.error;
 		v4l2_ctrl_handler_free(&state->ctrl_hdl);
 		return err;
 	}
-	v4l2_ctrl_handler_setup(&state->ctrl_hdl);
 	return 0;
 }
 static int adv7482_sdp_init_controls(struct adv7482_state *state)
 {
-	int err;
-	v4l2_ctrl_handler_init(&state->ctrl_hdl, 4);
+	v4l2_ctrl_handler_init(&state->ctrl_hdl, 10);
 	v4l2_ctrl_new_std(&state->ctrl_hdl, &adv7482_ctrl_ops,
 			  V4L2_CID_BRIGHTNESS, ADV7482_SDP_BRI_MIN,
 			  ADV7482_SDP_BRI_MAX, 1, ADV7482_SDP_BRI_DEF);
@@ -2090,14 +3837,17 @@ static int adv7482_sdp_init_controls(struct adv7482_state *state)
 	v4l2_ctrl_new_std(&state->ctrl_hdl, &adv7482_ctrl_ops,
 			  V4L2_CID_HUE, ADV7482_SDP_HUE_MIN,
 			  ADV7482_SDP_HUE_MAX, 1, ADV7482_SDP_HUE_DEF);
+	v4l2_ctrl_new_std_menu_items(&state->ctrl_hdl, &adv7482_ctrl_ops,
+			V4L2_CID_TEST_PATTERN,
+			ARRAY_SIZE(adv7482_test_pattern_menu) - 1, 0, 0,
+			adv7482_test_pattern_menu);
+	adv7482_hdmi_init_controls(state);
 	state->sd.ctrl_handler = &state->ctrl_hdl;
 	if (state->ctrl_hdl.error) {
 		int err = state->ctrl_hdl.error;
 		v4l2_ctrl_handler_free(&state->ctrl_hdl);
 		return err;
 	}
-	err = v4l2_ctrl_handler_setup(&state->ctrl_hdl);
-	pr_info("%s return %d\n",__FUNCTION__,err);
 	return 0;
 }
 static void adv7482_exit_controls(struct adv7482_state *state)
@@ -2110,22 +3860,45 @@ static void adv7482_exit_controls(struct adv7482_state *state)
 static int adv7482_parse_dt(struct device_node *np,
 			    struct adv7482_link_config *config)
 {
+	const char *input = "hdmi";
+	u32 vc_ch = 0;
 
+	/* Both properties are optional, HDMI on virtual channel 0 */
+	of_property_read_string(np, "adi,input", &input);
+	of_property_read_u32(np, "adi,virtual-channel", &vc_ch);
+	if (vc_ch > 3)
+		return -EINVAL;
 
-	 config->input_interface = DECODER_INPUT_INTERFACE_YCBCR422;
-	 config->regs =
-	 (struct adv7482_reg_value *)adv7482_init_txa_4lane;
-	 config->power_up =
-	 (struct adv7482_reg_value *)adv7482_power_up_txa_4lane;
-	 config->power_down =
-	 (struct adv7482_reg_value *)adv7482_power_down_txa_4lane;
-	 config->init_controls =
-	 (int (*)(void *))adv7482_cp_init_controls;
-
+	config->input_interface = DECODER_INPUT_INTERFACE_YCBCR422;
+	if (!strcmp(input, "cvbs")) {
+		/* Analog input, decoded by the SDP and sent out on TXA */
+		config->input = DECODER_INPUT_COMPOSITE;
+		config->regs =
+		(struct adv7482_reg_value *)adv7482_init_txb_1lane;
+		config->power_up =
+		(struct adv7482_reg_value *)adv7482_power_up_txa_4lane;
+		config->power_down =
+		(struct adv7482_reg_value *)adv7482_power_down_txa_4lane;
+		config->init_controls =
+		(int (*)(void *))adv7482_sdp_init_controls;
+	} else if (!strcmp(input, "hdmi")) {
+		config->input = DECODER_INPUT_HDMI;
+		config->regs =
+		(struct adv7482_reg_value *)adv7482_init_txa_4lane;
+		config->power_up =
+		(struct adv7482_reg_value *)adv7482_power_up_txa_4lane;
+		config->power_down =
+		(struct adv7482_reg_value *)adv7482_power_down_txa_4lane;
+		config->init_controls =
+		(int (*)(void *))adv7482_cp_init_controls;
+	} else {
+		return -EINVAL;
+	}
+	/* Both paths are set up once so s_routing only has to switch */
 	config->hdmi_in = 1;
-	config->sdp_in = 0;
+	config->sdp_in = 1;
 	config->sw_reset = 1;
-	config->vc_ch = 0;
+	config->vc_ch = vc_ch;
 	
 	config->init_device    = NULL;
 	config->s_power        = NULL;
@@ -2157,7 +3930,8 @@ static int adv7482_dai_set_sysclk(struct snd_soc_dai *dai,
 				  int clk_id, unsigned int freq, int dir)
 {
 	struct adv7482_state *state = dai_to_state(dai);
-	if (clk_id != 0 || freq != clk_get_rate(state->mclk_hw->clk)) {
+	/* MCLK follows the source, hw_params checks the ratio */
+	if (clk_id != 0) {
 		dev_err(state->dev, "invalid clock (%d) or frequency (%u, dir %d)\n",
 			clk_id, freq, dir);
 		return -EINVAL;
@@ -2182,15 +3956,12 @@ static int adv7482_dai_set_fmt(struct snd_soc_dai *dai, unsigned int fmt)
 	}
 	switch (fmt & SND_SOC_DAIFMT_FORMAT_MASK) {
 	case SND_SOC_DAIFMT_I2S:
-		state->tdm = 0;
 		state->fmt = ADV748X_I2SOUTMODE_I2S;
 		break;
 	case SND_SOC_DAIFMT_RIGHT_J:
-		state->tdm = 1;
 		state->fmt = ADV748X_I2SOUTMODE_RIGHT_J;
 		break;
 	case SND_SOC_DAIFMT_LEFT_J:
-		state->tdm = 1;
 		state->fmt = ADV748X_I2SOUTMODE_LEFT_J;
 		break;
 	default:
@@ -2206,30 +3977,61 @@ done:
 	return ret;
 }
 
+static const unsigned int adv7482_dai_channels[] = { 2, 8 };
+
+static const struct snd_pcm_hw_constraint_list adv7482_dai_channels_list = {
+	.count = ARRAY_SIZE(adv7482_dai_channels),
+	.list = adv7482_dai_channels,
+};
+
 static int adv7482_dai_startup(struct snd_pcm_substream *sub, struct snd_soc_dai *dai)
 {
-	u8 val;
 	int ret;
+	unsigned int rate;
 	struct adv7482_state *state = dai_to_state(dai);
 
-	ret = adv7482_read_register(state->client, ADV7482_I2C_IO,
-			0x0E, &val);
+	ret = adv7482_wait_init(state);
+	if (ret)
+		return ret;
+	ret = adv7482_update_bits(state, ADV7482_I2C_IO, 0x0E, 0x22, 0x00);
 	if (ret < 0)
 		return ret;
-	val &= ~0x22;
-	ret = adv7482_write_register(state->client, ADV7482_I2C_IO,
-			0x0E, val);
-	return 0;
+	ret = snd_pcm_hw_constraint_list(sub->runtime, 0,
+					 SNDRV_PCM_HW_PARAM_CHANNELS,
+					 &adv7482_dai_channels_list);
+	if (ret < 0)
+		return ret;
+	/* Capture at the rate the source sends, nothing resamples here */
+	mutex_lock(&state->mutex);
+	if (!state->irq_active)
+		adv7482_update_audio_rate(state);
+	rate = state->audio_rate;
+	state->audio_sub = sub;
+	mutex_unlock(&state->mutex);
+	return snd_pcm_hw_constraint_single(sub->runtime,
+					    SNDRV_PCM_HW_PARAM_RATE, rate);
 }
 
+/*
+ * adv7482_dai_hw_params() - Set up the audio port for a capture
+ * @sub: capture substream
+ * @params: requested parameters, the rate is fixed by startup
+ * @dai: DAI of the HDMI audio port
+ *
+ * The samples run from the HDMI ACR clock. To line them up with the
+ * video buffers, which are stamped in CLOCK_MONOTONIC, userspace selects
+ * SNDRV_PCM_TSTAMP_TYPE_MONOTONIC in its sw_params. The driver cannot
+ * choose it, sw_params overrides any default. ADV7482_CID_AUDIO_SPF
+ * gives the exact samples per video frame.
+ */
 static int adv7482_dai_hw_params(struct snd_pcm_substream *sub,
 				 struct snd_pcm_hw_params *params,
 				 struct snd_soc_dai *dai)
 {
 	int ret;
 	struct adv7482_state *state = dai_to_state(dai);
-	uint fs = state->freq / params_rate(params);
-	u8 val;
+	uint freq = state->freq ?: ADV7482_AUDIO_DEF_FS * params_rate(params);
+	uint fs = freq / params_rate(params);
 
 	dev_dbg(dai->dev, "dai %s substream %s rate=%u (fs=%u), channels=%u sample width=%u(%u)\n",
 		dai->name, sub->name,
@@ -2248,50 +4050,46 @@ static int adv7482_dai_hw_params(struct snd_pcm_substream *sub,
 	default:
 		ret = -EINVAL;
 		dev_err(dai->dev, "invalid clock frequency (%u) or rate (%u)\n",
-			state->freq, params_rate(params));
+			freq, params_rate(params));
 		goto done;
 	}
-	ret=adv7482_write_register(state->client, ADV7482_I2C_DPLL,0xB5,(fs / 128) - 1);
-	ret=adv7482_write_register(state->client, ADV7482_I2C_HDMI, 0x0f, state->tdm?0xc0:0x00);
-	ret=adv7482_write_register(state->client, ADV7482_I2C_HDMI, 0x6D, state->tdm?0x80:0x00);
-	ret=adv7482_write_register(state->client, ADV7482_I2C_HDMI, 0x03, (state->fmt<<5)|params_width(params));
+	if (params_rate(params) != state->audio_rate)
+		dev_warn(dai->dev, "capturing at %u Hz, source sends %u Hz\n",
+			 params_rate(params), state->audio_rate);
+	state->mclk_fs = fs;
+	/* All eight channels go out TDM on AP0, two are plain I2S */
+	state->tdm = params_channels(params) > 2;
+	ret = adv7482_write_register(state, ADV7482_I2C_DPLL, 0xB5, (fs / 128) - 1);
+	if (ret < 0)
+		goto done;
+	ret = adv7482_write_register(state, ADV7482_I2C_HDMI, 0x0f, state->tdm ? 0xc0 : 0x00);
+	if (ret < 0)
+		goto done;
+	ret = adv7482_write_register(state, ADV7482_I2C_HDMI, 0x6D, state->tdm ? 0x80 : 0x00);
+	if (ret < 0)
+		goto done;
+	ret = adv7482_write_register(state, ADV7482_I2C_HDMI, 0x03, (state->fmt << 5) | params_width(params));
 	done:
 	return ret;
 }
 
 static int adv7482_dai_mute_stream(struct snd_soc_dai *dai, int mute, int dir)
 {
-	u8 val;
-	int ret;
 	struct adv7482_state *state = dai_to_state(dai);
 
-	ret = adv7482_read_register(state->client, ADV7482_I2C_HDMI,
-			0x1A, &val);
-	if (ret < 0)
-		return ret;
-	if(mute)
-		val |= 0x10;
-	else
-		val &= ~0x10;
-	ret = adv7482_write_register(state->client, ADV7482_I2C_HDMI,
-			0x1A, val);
-	return ret;
+	return adv7482_update_bits(state, ADV7482_I2C_HDMI, 0x1A, 0x10,
+				   mute ? 0x10 : 0x00);
 }
 
 static void adv7482_dai_shutdown(struct snd_pcm_substream *sub, struct snd_soc_dai *dai)
 {
-	u8 val;
-	int ret;
 	struct adv7482_state *state = dai_to_state(dai);
 
-	ret = adv7482_read_register(state->client, ADV7482_I2C_IO,
-			0x0E, &val);
-	if (ret < 0)
-		return ;
-	val |= 0x22;
-	ret = adv7482_write_register(state->client, ADV7482_I2C_IO,
-			0x0E, val);
-
+	mutex_lock(&state->mutex);
+	if (state->audio_sub == sub)
+		state->audio_sub = NULL;
+	mutex_unlock(&state->mutex);
+	adv7482_update_bits(state, ADV7482_I2C_IO, 0x0E, 0x22, 0x22);
 }
 
 
@@ -2319,8 +4117,22 @@ static const struct snd_soc_component_driver adv7482_codec = {
 	.of_xlate_dai_name = adv748x_of_xlate_dai_name,
 };
 
+static unsigned long adv7482_mclk_recalc_rate(struct clk_hw *hw,
+					      unsigned long parent_rate)
+{
+	struct adv7482_state *state =
+		container_of(hw, struct adv7482_state, mclk_hw);
+
+	return (unsigned long)state->mclk_fs * state->audio_rate;
+}
+
+static const struct clk_ops adv7482_mclk_ops = {
+	.recalc_rate = adv7482_mclk_recalc_rate,
+};
+
 int adv7482_dai_init(struct adv7482_state *state)
 {
+	struct clk_init_data init = { };
 	int ret;
 	state->mclk_name = kasprintf(GFP_KERNEL, "%s.%s-i2s-mclk",
 				   state->dev->driver->name,
@@ -2330,15 +4142,18 @@ int adv7482_dai_init(struct adv7482_state *state)
 		printk("No memory for MCLK\n");
 		goto fail;
 	}
-	state->mclk_hw = clk_hw_register_fixed_rate(state->dev, state->mclk_name,
-						  NULL, 0, 12288000);
-	if (IS_ERR(state->mclk_hw)) {
-		ret = PTR_ERR(state->mclk_hw);
+	init.name = state->mclk_name;
+	init.ops = &adv7482_mclk_ops;
+	/* The rate changes with the source, never cache it */
+	init.flags = CLK_GET_RATE_NOCACHE;
+	state->mclk_hw.init = &init;
+	ret = clk_hw_register(state->dev, &state->mclk_hw);
+	if (ret < 0) {
 		printk("Failed to register MCLK (%d)\n", ret);
 		goto fail;
 	}
 	ret = of_clk_add_hw_provider(state->dev->of_node, of_clk_hw_simple_get,
-				     state->mclk_hw->clk);
+				     &state->mclk_hw);
 	if (ret < 0) {
 		printk("Failed to add MCLK provider (%d)\n", ret);
 		goto unreg_mclk;
@@ -2347,9 +4162,12 @@ int adv7482_dai_init(struct adv7482_state *state)
 	state->dai_drv.ops = &adv7482_dai_ops;
 	state->dai_drv.capture = (const struct snd_soc_pcm_stream){
 		.stream_name	= "Capture",
-		.channels_min	= 8,
+		.channels_min	= 2,
 		.channels_max	= 8,
-		.rates = SNDRV_PCM_RATE_48000,
+		.rates = SNDRV_PCM_RATE_32000 | SNDRV_PCM_RATE_44100 |
+			 SNDRV_PCM_RATE_48000 | SNDRV_PCM_RATE_88200 |
+			 SNDRV_PCM_RATE_96000 | SNDRV_PCM_RATE_176400 |
+			 SNDRV_PCM_RATE_192000,
 		.formats = SNDRV_PCM_FMTBIT_S24_LE | SNDRV_PCM_FMTBIT_U24_LE,
 	};
 
@@ -2363,7 +4181,7 @@ int adv7482_dai_init(struct adv7482_state *state)
 cleanup_mclk:
 	of_clk_del_provider(state->dev->of_node);
 unreg_mclk:
-	clk_hw_unregister_fixed_rate(state->mclk_hw);
+	clk_hw_unregister(&state->mclk_hw);
 fail:
 	return ret;
 }
@@ -2371,10 +4189,161 @@ fail:
 void adv7482_dai_cleanup(struct adv7482_state *state)
 {
 	of_clk_del_provider(state->dev->of_node);
-	clk_hw_unregister_fixed_rate(state->mclk_hw);
+	clk_hw_unregister(&state->mclk_hw);
 	kfree(state->mclk_name);
 }
 
+/*
+ * adv7482_init_work - Program the ADV7482 register tables
+ * @work: pointer to the init_work member of adv7482_state
+ *
+ * Runs the software reset and the init tables off the probe path. Users
+ * of the hardware wait for it with adv7482_wait_init().
+ */
+static void adv7482_init_work(struct work_struct *work)
+{
+	struct adv7482_state *state = container_of(work, struct adv7482_state,
+						   init_work);
+	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
+	const struct adv7482_edid_preset *preset;
+	int ret = 0;
+
+	/* SW reset ADV7482 to its default values */
+	ret = adv7482_bootstrap(state);
+	if (ret < 0) {
+		dev_err(state->dev, "adv7482_bootstrap failed\n");
+		goto out;
+	}
+	ret = adv7482_init_regmaps(state);
+	if (ret < 0) {
+		dev_err(state->dev, "failed to create regmaps: %d\n", ret);
+		goto out;
+	}
+	if (config->sw_reset) {
+		/* check rd_info */
+		{
+			u8 msb;
+			u8 lsb;
+			ret = adv7482_read_register(state, ADV7482_I2C_IO,
+					ADV7482_IO_RD_INFO1_REG, &lsb);
+			if (ret < 0){
+				dev_err(state->dev, "adv7482_read_register ADV7482_I2C_IO failed\n");
+				goto out;
+			}else{
+				dev_err(state->dev, "adv7482_read_register ADV7482_I2C_IO success\n");
+			}
+			ret = adv7482_read_register(state, ADV7482_I2C_IO,
+					ADV7482_IO_RD_INFO2_REG, &msb);
+			if (ret < 0)
+				goto out;
+			v4l_info(state->client, "adv7482 revision is %02x%02x\n",
+					lsb, msb);
+		}
+	}
+	if (config->hdmi_in) {
+		ret = adv7482_write_registers(state,
+				adv7482_init_txa_4lane);
+		if (ret < 0)
+			goto out;
+		preset = &adv7482_edid_presets[min_t(unsigned int, edid_preset,
+				ARRAY_SIZE(adv7482_edid_presets) - 1)];
+		ret = adv7482_set_edid(state, preset->edid, preset->blocks);
+		if (ret < 0)
+			goto out;
+		/* Power down */
+		ret = adv7482_write_registers(state,
+				adv7482_power_down_txa_4lane);
+		if (ret < 0)
+			goto out;
+	} else
+		v4l_info(state->client, "adv7482 hdmi_in is disabled.\n");
+	/* Initializes ADV7482 to its default values */
+	if (config->sdp_in) {
+		ret = adv7482_write_registers(state,
+						adv7482_init_txb_1lane);
+		if (ret < 0)
+			goto out;
+		/* Power down */
+		ret = adv7482_write_registers(state,
+						adv7482_power_down_txb_1lane);
+		if (ret < 0)
+			goto out;
+	} else
+		v4l_info(state->client, "adv7482 sdp_in is disabled.\n");
+	if (config->sdp_in && config->hdmi_in) { 
+		/* Power up hdmi rx */
+		ret = adv7482_write_registers(state,
+						adv7482_power_up_hdmi_rx);
+		if (ret < 0)
+			goto out;
+		/* Enable csi4 and sci1 */
+		ret = adv7482_write_registers(state,
+						adv7482_enable_csi4_csi1);
+		if (ret < 0)
+			goto out;
+		v4l_info(state->client, "adv7482 enable csi1 and csi4\n");
+	}
+
+	/* Setting virtual channel for ADV7482 */
+	if (config->vc_ch == 0)
+		ret = adv7482_write_registers(state,
+					adv7482_set_virtual_channel0);
+	else if (config->vc_ch == 1)
+		ret = adv7482_write_registers(state,
+					adv7482_set_virtual_channel1);
+	else if (config->vc_ch == 2)
+		ret = adv7482_write_registers(state,
+					adv7482_set_virtual_channel2);
+	else if (config->vc_ch == 3)
+		ret = adv7482_write_registers(state,
+					adv7482_set_virtual_channel3);
+	dev_err(state->dev, "adv7482_write_registers %d chanels return %d\n",
+		config->vc_ch,ret);
+	if (ret < 0)
+		goto out;
+	ret = adv7482_route_input(state);
+	if (ret < 0)
+		goto out;
+
+	if (state->irq > 0) {
+		ret = adv7482_irq_enable(state);
+		if (ret < 0)
+			goto out;
+		ret = request_threaded_irq(state->irq, NULL,
+				adv7482_irq_thread, IRQF_ONESHOT,
+				dev_name(state->dev), state);
+		if (ret < 0) {
+			dev_err(state->dev, "failed to request irq %d: %d\n",
+				state->irq, ret);
+			goto out;
+		}
+		state->irq_active = true;
+	}
+
+out:
+	state->init_ret = ret;
+	complete_all(&state->init_done);
+	/* s_ctrl waits for init_done, so this has to come after it */
+	if (!ret)
+		v4l2_ctrl_handler_setup(&state->ctrl_hdl);
+}
+
+/*
+ * adv7482_wait_init - Wait for the asynchronous initialisation
+ * @state: pointer to private state structure
+ *
+ * Returns the result of the init tables, or -ERESTARTSYS when interrupted.
+ */
+static int adv7482_wait_init(struct adv7482_state *state)
+{
+	int ret;
+
+	ret = wait_for_completion_interruptible(&state->init_done);
+	if (ret)
+		return ret;
+	return state->init_ret;
+}
+
 /*
  * adv7482_probe - Probe a ADV7482 device
  * @client: pointer to i2c_client structure
@@ -2386,7 +4355,7 @@ static int adv7482_probe(struct i2c_client *client,
 			const struct i2c_device_id *id)
 {
 	struct adv7482_state *state;
-	struct adv7482_link_config link_config;
+	struct adv7482_link_config *config;
 	struct device *dev = &client->dev;
 	struct v4l2_subdev *sd;
 	int ret;
@@ -2403,16 +4372,15 @@ static int adv7482_probe(struct i2c_client *client,
 	}
 	state->client = client;
 	state->irq = client->irq;
-	ret = adv7482_parse_dt(dev->of_node, &link_config);
+	config = &state->mipi_csi2_link[0];
+	ret = adv7482_parse_dt(dev->of_node, config);
 	if (ret) {
 		dev_err(&client->dev, "adv7482 parse error\n");
-		return ret;
+		goto err_free_state;
 	}else{
 		dev_err(&client->dev, "adv7482 parse success\n");
 	}
-	state->mipi_csi2_link[0].input_interface = link_config.input_interface;
-	state->mipi_csi2_link[0].input = DECODER_INPUT_HDMI;
-	printk("input_interface=%x\n",link_config.input_interface);
+	printk("input_interface=%x\n",config->input_interface);
 	
 	mutex_init(&state->mutex);
 	state->autodetect = true;
@@ -2422,6 +4390,12 @@ static int adv7482_probe(struct i2c_client *client,
 	state->height = ADV7482_MAX_HEIGHT;
 	state->field = V4L2_FIELD_NONE;
 	state->field = V4L2_FIELD_NONE;
+	state->fmt.width = state->width;
+	state->fmt.height = state->height;
+	state->fmt.field = state->field;
+	adv7482_set_csc(state, &state->fmt);
+	state->audio_rate = ADV7482_AUDIO_DEF_RATE;
+	state->mclk_fs = ADV7482_AUDIO_DEF_FS;
 	if(sd->name)
 		printk("sd->name=%s\n",sd->name);
 	else
@@ -2430,7 +4404,7 @@ static int adv7482_probe(struct i2c_client *client,
 		strcpy(sd->name,"adv748[12]");
 	}
 
-	state->sd.flags = V4L2_SUBDEV_FL_HAS_DEVNODE;
+	state->sd.flags = V4L2_SUBDEV_FL_HAS_DEVNODE | V4L2_SUBDEV_FL_HAS_EVENTS;
 	state->sd.grp_id = 678;
 	state->dev		= dev;
 
@@ -2439,91 +4413,20 @@ static int adv7482_probe(struct i2c_client *client,
 	i2c_set_clientdata(client,state);
 
 	state->mipi_csi2_link[0].dev = dev;
-	/* SW reset ADV7482 to its default values */
-	if (link_config.sw_reset) {
-		ret = adv7482_write_registers(client, adv7482_sw_reset);
-		if (ret < 0){
-			dev_err(&client->dev, "adv7482_write_registers failed\n");
-			goto err_unreg_subdev;
-		}else{
-			dev_err(&client->dev, "adv7482_write_registers success\n");
-		}
-		/* check rd_info */
-		{
-			u8 msb;
-			u8 lsb;
-			ret = adv7482_read_register(client, ADV7482_I2C_IO,
-					ADV7482_IO_RD_INFO1_REG, &lsb);
-			if (ret < 0){
-				dev_err(&client->dev, "adv7482_read_register ADV7482_I2C_IO failed\n");
-				return ret;
-			}else{
-				dev_err(&client->dev, "adv7482_read_register ADV7482_I2C_IO success\n");
-			}
-			ret = adv7482_read_register(client, ADV7482_I2C_IO,
-					ADV7482_IO_RD_INFO2_REG, &msb);
-			if (ret < 0)
-				return ret;
-			v4l_info(client, "adv7482 revision is %02x%02x\n",
-					lsb, msb);
-		}
+	ret = adv7482_init_clients(state);
+	if (ret < 0) {
+		dev_err(&client->dev, "failed to create map clients: %d\n", ret);
+		goto err_unreg_subdev;
 	}
-	if (link_config.hdmi_in) {
-		ret = adv7482_write_registers(client,
-				adv7482_init_txa_4lane);
-		if (ret < 0)
-			goto err_unreg_subdev;
-		/* Power down */
-		ret = adv7482_write_registers(client,
-				adv7482_power_down_txa_4lane);
-		if (ret < 0)
-			goto err_unreg_subdev;
-	} else
-		v4l_info(client, "adv7482 hdmi_in is disabled.\n");
-	/* Initializes ADV7482 to its default values */
-	if (link_config.sdp_in) {
-		ret = adv7482_write_registers(client,
-						adv7482_init_txb_1lane);
-		if (ret < 0)
-			goto err_unreg_subdev;
-		/* Power down */
-		ret = adv7482_write_registers(client,
-						adv7482_power_down_txb_1lane);
-		if (ret < 0)
-			goto err_unreg_subdev;
-	} else
-		v4l_info(client, "adv7482 sdp_in is disabled.\n");
-	if (link_config.sdp_in && link_config.hdmi_in) { 
-		/* Power up hdmi rx */
-		ret = adv7482_write_registers(client,
-						adv7482_power_up_hdmi_rx);
-		if (ret < 0)
-			goto err_unreg_subdev;
-		/* Enable csi4 and sci1 */
-		ret = adv7482_write_registers(client,
-						adv7482_enable_csi4_csi1);
-		if (ret < 0)
-			goto err_unreg_subdev;
-		v4l_info(client, "adv7482 enable csi1 and csi4\n");
+	ret = config->init_controls(state);
+	if (ret < 0) {
+		dev_err(&client->dev, "failed to init controls: %d\n", ret);
+		goto err_unreg_subdev;
 	}
+	init_completion(&state->init_done);
+	INIT_WORK(&state->init_work, adv7482_init_work);
+	queue_work(system_long_wq, &state->init_work);
 
-	/* Setting virtual channel for ADV7482 */
-	if (link_config.vc_ch == 0)
-		ret = adv7482_write_registers(client,
-					adv7482_set_virtual_channel0);
-	else if (link_config.vc_ch == 1)
-		ret = adv7482_write_registers(client,
-					adv7482_set_virtual_channel1);
-	else if (link_config.vc_ch == 2)
-		ret = adv7482_write_registers(client,
-					adv7482_set_virtual_channel2);
-	else if (link_config.vc_ch == 3)
-		ret = adv7482_write_registers(client,
-					adv7482_set_virtual_channel3);
-	dev_err(&client->dev, "adv7482_write_registers %d chanels return %d\n",
-		link_config.vc_ch,ret);
-	if (ret < 0)
-		goto err_unreg_subdev;
 	state->pad.flags = MEDIA_PAD_FL_SOURCE;
 	
 	state->sd.entity.function  = MEDIA_ENT_F_VID_IF_BRIDGE;
@@ -2549,10 +4452,14 @@ static int adv7482_probe(struct i2c_client *client,
 
 	return 0;
 err_free_ctrl:
+	cancel_work_sync(&state->init_work);
+	if (state->irq_active)
+		free_irq(state->irq, state);
 	adv7482_exit_controls(state);
 err_unreg_subdev:
 	mutex_destroy(&state->mutex);
 	v4l2_device_unregister_subdev(&state->sd);
+err_free_state:
 	kfree(state);
 err:
 	dev_err(&client->dev, ": Failed to probe: %d\n", ret);
@@ -2566,14 +4473,18 @@ err:
  */
 static void adv7482_remove(struct i2c_client *client)
 {
-	struct v4l2_subdev *sd = i2c_get_clientdata(client);
-	struct adv7482_state *state = to_state(sd);
+	struct adv7482_state *state = i2c_get_clientdata(client);
+	struct v4l2_subdev *sd = &state->sd;
+
+	cancel_work_sync(&state->init_work);
+	if (state->irq_active)
+		free_irq(state->irq, state);
 	adv7482_dai_cleanup(state);
 	v4l2_async_unregister_subdev(sd);
 	media_entity_cleanup(&sd->entity);
 	adv7482_exit_controls(state);
 	mutex_destroy(&state->mutex);
-	kfree(to_state(sd));
+	kfree(state);
 	
 }
 static const struct i2c_device_id adv7482_id[] = {
@@ -2581,55 +4492,185 @@ static const struct i2c_device_id adv7482_id[] = {
 	{},
 };
 #ifdef CONFIG_PM_SLEEP
+/* Restore order: chip and map setup first, the CSI transmitters last */
+static const enum adv7482_page adv7482_sync_order[] = {
+	ADV7482_PAGE_IO,
+	ADV7482_PAGE_DPLL,
+	ADV7482_PAGE_CP,
+	ADV7482_PAGE_EDID,
+	ADV7482_PAGE_REPEATER,
+	ADV7482_PAGE_HDMI,
+	ADV7482_PAGE_SDP,
+	ADV7482_PAGE_TXB,
+	ADV7482_PAGE_TXA,
+};
+/*
+ * adv7482_replay_volatile() - Write the uncached entries of a register table
+ * @state: pointer to private state structure
+ * @regs: init table that was written before the suspend
+ *
+ * regcache_sync() cannot restore writes to volatile registers. The SDP
+ * map is almost entirely volatile, so its map-select writes are replayed
+ * with it to keep the sub-map entries landing in the right map.
+ */
+static int adv7482_replay_volatile(struct adv7482_state *state,
+				   const struct adv7482_reg_value *regs)
+{
+	const struct regmap_config *cfg;
+	bool written = false;
+	unsigned int page;
+	int ret;
+
+	for (; regs->addr != ADV7482_I2C_EOR; regs++) {
+		if (regs->addr == ADV7482_I2C_WAIT) {
+			if (written)
+				msleep(regs->value);
+			written = false;
+			continue;
+		}
+		for (page = 0; page < ADV7482_PAGE_MAX; page++)
+			if (adv7482_page_addr[page] == regs->addr)
+				break;
+		if (page == ADV7482_PAGE_MAX)
+			return -EINVAL;
+		cfg = &adv7482_regmap_cfg[page];
+		if (cfg->cache_type != REGCACHE_NONE && page != ADV7482_PAGE_SDP &&
+		    !(cfg->volatile_reg && cfg->volatile_reg(state->dev, regs->reg)))
+			continue;
+		ret = adv7482_write_register(state, regs->addr, regs->reg,
+					     regs->value);
+		if (ret < 0)
+			return ret;
+		written = true;
+	}
+	return 0;
+}
+/*
+ * adv7482_replay_init() - Restore what regcache_sync() cannot
+ * @state: pointer to private state structure
+ *
+ * Walks the tables adv7482_init_work() wrote, in the same order.
+ */
+static int adv7482_replay_init(struct adv7482_state *state)
+{
+	static const struct adv7482_reg_value *vc_tables[] = {
+		adv7482_set_virtual_channel0, adv7482_set_virtual_channel1,
+		adv7482_set_virtual_channel2, adv7482_set_virtual_channel3,
+	};
+	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
+	const struct adv7482_reg_value *tables[7];
+	unsigned int i, n = 0;
+	int ret;
+
+	if (config->hdmi_in) {
+		tables[n++] = adv7482_init_txa_4lane;
+		tables[n++] = adv7482_power_down_txa_4lane;
+	}
+	if (config->sdp_in) {
+		tables[n++] = adv7482_init_txb_1lane;
+		tables[n++] = adv7482_power_down_txb_1lane;
+	}
+	if (config->sdp_in && config->hdmi_in) {
+		tables[n++] = adv7482_power_up_hdmi_rx;
+		tables[n++] = adv7482_enable_csi4_csi1;
+	}
+	/* adv7482_parse_dt() keeps vc_ch within 0-3 */
+	tables[n++] = vc_tables[config->vc_ch];
+
+	for (i = 0; i < n; i++) {
+		ret = adv7482_replay_volatile(state, tables[i]);
+		if (ret < 0)
+			return ret;
+	}
+	return 0;
+}
 /*
  * adv7482_suspend - Suspend ADV7482 device
- * @client: pointer to i2c_client structure
- * @state: power management state
+ * @dev: pointer to device structure
  *
- * Power down the ADV7482 device
+ * Power down the ADV7482 device and freeze the register cache
  */
 static int adv7482_suspend(struct device *dev)
 {
 	struct i2c_client *client = to_i2c_client(dev);
+	struct adv7482_state *state = i2c_get_clientdata(client);
+	struct adv7482_link_config *config = &state->mipi_csi2_link[0];
+	unsigned int page;
 	int ret;
-	ret = adv7482_write_register(client, ADV7482_I2C_IO,
+
+	flush_work(&state->init_work);
+	if (state->init_ret)
+		return 0;
+	if (state->irq_active)
+		disable_irq(state->irq);
+
+	mutex_lock(&state->mutex);
+	/* Leave the transmitters in the cache in their powered down state */
+	if (config->hdmi_in)
+		adv7482_write_registers(state, adv7482_power_down_txa_4lane);
+	if (config->sdp_in)
+		adv7482_write_registers(state, adv7482_power_down_txb_1lane);
+
+	regcache_cache_bypass(state->regmap[ADV7482_PAGE_IO], true);
+	ret = adv7482_write_register(state, ADV7482_I2C_IO,
 				ADV7482_IO_PWR_MAN_REG, ADV7482_IO_PWR_OFF);
+	regcache_cache_bypass(state->regmap[ADV7482_PAGE_IO], false);
+
+	for (page = 0; page < ADV7482_PAGE_MAX; page++) {
+		regcache_cache_only(state->regmap[page], true);
+		regcache_mark_dirty(state->regmap[page]);
+	}
+	mutex_unlock(&state->mutex);
 	return ret;
 }
 /*
  * adv7482_resume - Resume ADV7482 device
- * @client: pointer to i2c_client structure
+ * @dev: pointer to device structure
  *
- * Power on and initialize the ADV7482 device
+ * Reset the ADV7482 device, write back the cached registers and replay
+ * the init writes to volatile registers
  */
 static int adv7482_resume(struct device *dev)
 {
 	struct i2c_client *client = to_i2c_client(dev);
-	struct adv7482_link_config link_config;
+	struct adv7482_state *state = i2c_get_clientdata(client);
+	unsigned int i, page;
 	int ret;
-	ret = adv7482_write_register(client, ADV7482_I2C_IO,
-				ADV7482_IO_PWR_MAN_REG, ADV7482_IO_PWR_ON);
+
+	if (state->init_ret)
+		return 0;
+
+	mutex_lock(&state->mutex);
+	ret = adv7482_bootstrap(state);
+	for (page = 0; page < ADV7482_PAGE_MAX; page++)
+		regcache_cache_only(state->regmap[page], false);
 	if (ret < 0)
-		return ret;
-	ret = adv7482_parse_dt(dev->of_node, &link_config);
-	if (ret)
-		return ret;
-	/* Initializes ADV7482 to its default values */
-	ret = adv7482_write_registers(client, link_config.regs);
-	/* Power down */
-	ret = adv7482_write_registers(client, link_config.power_down);
-	if (link_config.sdp_in && link_config.hdmi_in) {
-		/* Power up hdmi rx */
-		ret = adv7482_write_registers(client,
-						adv7482_power_up_hdmi_rx);
+		goto out;
+
+	for (i = 0; i < ARRAY_SIZE(adv7482_sync_order); i++) {
+		ret = regcache_sync(state->regmap[adv7482_sync_order[i]]);
 		if (ret < 0)
-			return ret;
-		/* Enable csi4 and sci1 */
-		ret = adv7482_write_registers(client,
-						adv7482_enable_csi4_csi1);
+			goto out;
+	}
+	ret = adv7482_replay_init(state);
+	if (ret < 0)
+		goto out;
+
+	if (state->irq_active) {
+		ret = adv7482_irq_enable(state);
 		if (ret < 0)
-			return ret;
+			goto out;
 	}
+
+	if (state->powered)
+		ret = adv7482_set_power(state, true);
+out:
+	mutex_unlock(&state->mutex);
+	if (state->irq_active)
+		enable_irq(state->irq);
+	/* The SDP picture controls live in volatile registers */
+	if (!ret)
+		ret = v4l2_ctrl_handler_setup(&state->ctrl_hdl);
 	return ret;
 }
 static SIMPLE_DEV_PM_OPS(adv7482_pm_ops, adv7482_suspend, adv7482_resume);
@@ -2646,7 +4687,7 @@ MODULE_DEVICE_TABLE(of, adv7482_of_ids);
 static struct i2c_driver adv7482_driver = {
 	.driver = {
 		.name	= DRIVER_NAME,
-		// .pm = ADV7482_PM_OPS,
+		.pm = ADV7482_PM_OPS,
 		.of_match_table = adv7482_of_ids,
 	},
 	.probe		= adv7482_probe,
@@ -25,4 +25,16 @@
 #define V4L2_MBUS_CSI2_LANES		(V4L2_MBUS_CSI2_1_LANE | \
 									 V4L2_MBUS_CSI2_2_LANE | \
 									 V4L2_MBUS_CSI2_3_LANE | \
-									 V4L2_MBUS_CSI2_4_LANE)
\ No newline at end of file
+									 V4L2_MBUS_CSI2_4_LANE)
+/* s_routing inputs, in the order the capture driver lists them */
+#define ADV7482_ROUTE_HDMI			0
+#define ADV7482_ROUTE_CVBS			1
+
+/*
+ * Sent through v4l2_subdev_notify(), arg points to a bool that is true
+ * while the CP free-runs because the HDMI input is not locked
+ */
+#define ADV7482_NOTIFY_NO_SIGNAL		_IOW('a', 1, bool)
+
+/* core ioctl, arg points to a u32 set to the ADV7482_ROUTE_* in use */
+#define ADV7482_G_ROUTING			_IOR('a', 2, u32)
@@ -46,12 +46,19 @@
 #include <media/videobuf2-core.h>
 #include <media/videobuf2-dma-contig.h>
 
+#include "adv7482.h"
+
 #define MX6S_CAM_DRV_NAME "mx6s-csi"
 #define MX6S_CAM_VERSION "0.0.1"
 #define MX6S_CAM_DRIVER_DESCRIPTION "i.MX6S_CSI"
 
 #define MAX_VIDEO_MEM 64
 
+static int autosuspend_delay_ms = 2000;
+module_param(autosuspend_delay_ms, int, 0444);
+MODULE_PARM_DESC(autosuspend_delay_ms,
+		 "Idle time before the CSI is powered down (ms, -1 = never)");
+
 /* reset values */
 #define CSICR1_RESET_VAL	0x40000800
 #define CSICR2_RESET_VAL	0x0
@@ -251,6 +258,12 @@ static struct mx6s_fmt formats[] = {
 		.pixelformat	= V4L2_PIX_FMT_ABGR32  ,
 		.mbus_code	= MEDIA_BUS_FMT_RGB888_1X24, 
 		.bpp		= 4,
+	}, {
+		.name		= "UYVY-16",
+		.fourcc		= V4L2_PIX_FMT_UYVY,
+		.pixelformat	= V4L2_PIX_FMT_UYVY,
+		.mbus_code	= MEDIA_BUS_FMT_UYVY8_2X8,
+		.bpp		= 2,
 	}
 	
 };
@@ -301,16 +314,26 @@ struct mx6s_csi_dev {
 	void __iomem *regbase;
 	int irq;
 
+	/* shadow of CSICR1/2/3/18, see csi_regs_flush() */
+	u32 cr1;
+	u32 cr2;
+	u32 cr3;
+	u32 cr18;
+	u32 cr_dirty;
+
 	u32      nextfb;
 	u32      skipframe;
 	u32	 type;
 	u32 bytesperline;
 	v4l2_std_id std;
+	unsigned int input;
 	struct mx6s_fmt		*fmt;
 	struct v4l2_pix_format pix;
 	u32 mbus_code;
 
 	unsigned int frame_count;
+	/* the decoder sends free-running frames, see mx6s_csi_notify() */
+	bool no_signal;
 
 	struct list_head	capture;
 	struct list_head	active_bufs;
@@ -393,50 +416,91 @@ void csi_clk_disable(struct mx6s_csi_dev *csi_dev)
 	clk_disable_unprepare(csi_dev->clk_disp_axi);
 }
 
+/*
+ * CSICR1/2/3/18 are only ever changed through the shadow copies in
+ * struct mx6s_csi_dev. Helpers update the copy and mark it dirty,
+ * csi_regs_flush() then writes the dirty registers out without reading
+ * the hardware back. Self-clearing bits (CLR_RXFIFO, DMA_REFLASH_RFF,
+ * FRMCNT_RST) are pulsed on top of the shadow value and never stored.
+ * The IRQ handler recovers errors through the same copies, so every
+ * change to them is made with slock held.
+ */
+#define CSI_DIRTY_CR1	BIT(0)
+#define CSI_DIRTY_CR2	BIT(1)
+#define CSI_DIRTY_CR3	BIT(2)
+#define CSI_DIRTY_CR18	BIT(3)
+
+static void csi_regs_flush(struct mx6s_csi_dev *csi_dev)
+{
+	/* CR18 holds the CSI enable bit and goes out last */
+	if (csi_dev->cr_dirty & CSI_DIRTY_CR2)
+		csi_write(csi_dev, csi_dev->cr2, CSI_CSICR2);
+	if (csi_dev->cr_dirty & CSI_DIRTY_CR3)
+		csi_write(csi_dev, csi_dev->cr3, CSI_CSICR3);
+	if (csi_dev->cr_dirty & CSI_DIRTY_CR1)
+		csi_write(csi_dev, csi_dev->cr1, CSI_CSICR1);
+	if (csi_dev->cr_dirty & CSI_DIRTY_CR18)
+		csi_write(csi_dev, csi_dev->cr18, CSI_CSICR18);
+
+	csi_dev->cr_dirty = 0;
+}
+
+/* reflash the embeded DMA controller */
+static void csi_dma_reflash(struct mx6s_csi_dev *csi_dev)
+{
+	csi_write(csi_dev, csi_dev->cr3 | BIT_DMA_REFLASH_RFF, CSI_CSICR3);
+	csi_dev->cr_dirty &= ~CSI_DIRTY_CR3;
+}
+
 static void csihw_reset(struct mx6s_csi_dev *csi_dev)
 {
-	__raw_writel(__raw_readl(csi_dev->regbase + CSI_CSICR3)
-			| BIT_FRMCNT_RST,
-			csi_dev->regbase + CSI_CSICR3);
+	csi_write(csi_dev, csi_dev->cr3 | BIT_FRMCNT_RST, CSI_CSICR3);
 
-	__raw_writel(CSICR1_RESET_VAL, csi_dev->regbase + CSI_CSICR1);
-	__raw_writel(CSICR2_RESET_VAL, csi_dev->regbase + CSI_CSICR2);
-	__raw_writel(CSICR3_RESET_VAL, csi_dev->regbase + CSI_CSICR3);
+	csi_dev->cr1 = CSICR1_RESET_VAL;
+	csi_dev->cr2 = CSICR2_RESET_VAL;
+	csi_dev->cr3 = CSICR3_RESET_VAL;
+	csi_write(csi_dev, csi_dev->cr1, CSI_CSICR1);
+	csi_write(csi_dev, csi_dev->cr2, CSI_CSICR2);
+	csi_write(csi_dev, csi_dev->cr3, CSI_CSICR3);
+	csi_dev->cr_dirty &= ~(CSI_DIRTY_CR1 | CSI_DIRTY_CR2 | CSI_DIRTY_CR3);
 }
 
 static void csisw_reset(struct mx6s_csi_dev *csi_dev)
 {
-	int cr1, cr3, cr18, isr;
+	unsigned long flags;
+	int isr;
 
+	spin_lock_irqsave(&csi_dev->slock, flags);
 	/* Disable csi  */
-	cr18 = csi_read(csi_dev, CSI_CSICR18);
-	cr18 &= ~BIT_CSI_ENABLE;
-	csi_write(csi_dev, cr18, CSI_CSICR18);
+	csi_dev->cr18 &= ~BIT_CSI_ENABLE;
+	csi_write(csi_dev, csi_dev->cr18, CSI_CSICR18);
 
 	/* Clear RX FIFO */
-	cr1 = csi_read(csi_dev, CSI_CSICR1);
-	csi_write(csi_dev, cr1 & ~BIT_FCC, CSI_CSICR1);
-	cr1 = csi_read(csi_dev, CSI_CSICR1);
-	csi_write(csi_dev, cr1 | BIT_CLR_RXFIFO, CSI_CSICR1);
+	csi_dev->cr1 &= ~BIT_FCC;
+	csi_write(csi_dev, csi_dev->cr1, CSI_CSICR1);
+	csi_write(csi_dev, csi_dev->cr1 | BIT_CLR_RXFIFO, CSI_CSICR1);
 
 	/* DMA reflash */
-	cr3 = csi_read(csi_dev, CSI_CSICR3);
-	cr3 |= BIT_DMA_REFLASH_RFF | BIT_FRMCNT_RST;
-	csi_write(csi_dev, cr3, CSI_CSICR3);
+	csi_write(csi_dev, csi_dev->cr3 | BIT_DMA_REFLASH_RFF | BIT_FRMCNT_RST,
+		  CSI_CSICR3);
+	spin_unlock_irqrestore(&csi_dev->slock, flags);
 
 	msleep(2);
 
-	cr1 = csi_read(csi_dev, CSI_CSICR1);
-	csi_write(csi_dev, cr1 | BIT_FCC, CSI_CSICR1);
+	spin_lock_irqsave(&csi_dev->slock, flags);
+	csi_dev->cr1 |= BIT_FCC;
+	csi_write(csi_dev, csi_dev->cr1, CSI_CSICR1);
 
 	isr = csi_read(csi_dev, CSI_CSISR);
 	csi_write(csi_dev, isr, CSI_CSISR);
 
-	cr18 |= csi_dev->soc->baseaddr_switch;
+	csi_dev->cr18 |= csi_dev->soc->baseaddr_switch;
 
 	/* Enable csi  */
-	cr18 |= BIT_CSI_ENABLE;
-	csi_write(csi_dev, cr18, CSI_CSICR18);
+	csi_dev->cr18 |= BIT_CSI_ENABLE;
+	csi_write(csi_dev, csi_dev->cr18, CSI_CSICR18);
+	csi_dev->cr_dirty &= ~(CSI_DIRTY_CR1 | CSI_DIRTY_CR18);
+	spin_unlock_irqrestore(&csi_dev->slock, flags);
 }
 
 /*!
@@ -455,54 +519,47 @@ static void csi_init_interface(struct mx6s_csi_dev *csi_dev)
 	val |= BIT_FCC;
 	val |= 1 << SHIFT_MCLKDIV;
 	val |= BIT_MCLKEN;
-	__raw_writel(val, csi_dev->regbase + CSI_CSICR1);
+	csi_dev->cr1 = val;
+	csi_write(csi_dev, csi_dev->cr1, CSI_CSICR1);
 
 	imag_para = (640 << 16) | 960;
 	__raw_writel(imag_para, csi_dev->regbase + CSI_CSIIMAG_PARA);
 
-	val = BIT_DMA_REFLASH_RFF;
-	__raw_writel(val, csi_dev->regbase + CSI_CSICR3);
+	csi_dev->cr3 = 0;
+	csi_dma_reflash(csi_dev);
+	csi_dev->cr_dirty &= ~CSI_DIRTY_CR1;
 }
 
 static void csi_enable_int(struct mx6s_csi_dev *csi_dev, int arg)
 {
-	unsigned long cr1 = __raw_readl(csi_dev->regbase + CSI_CSICR1);
-
-	cr1 |= BIT_SOF_INTEN;
-	cr1 |= BIT_RFF_OR_INT;
+	csi_dev->cr1 |= BIT_SOF_INTEN;
+	csi_dev->cr1 |= BIT_RFF_OR_INT;
 	if (arg == 1) {
 		/* still capture needs DMA intterrupt */
-		cr1 |= BIT_FB1_DMA_DONE_INTEN;
-		cr1 |= BIT_FB2_DMA_DONE_INTEN;
+		csi_dev->cr1 |= BIT_FB1_DMA_DONE_INTEN;
+		csi_dev->cr1 |= BIT_FB2_DMA_DONE_INTEN;
 	}
-	__raw_writel(cr1, csi_dev->regbase + CSI_CSICR1);
+	csi_dev->cr_dirty |= CSI_DIRTY_CR1;
 }
 
 static void csi_disable_int(struct mx6s_csi_dev *csi_dev)
 {
-	unsigned long cr1 = __raw_readl(csi_dev->regbase + CSI_CSICR1);
-
-	cr1 &= ~BIT_SOF_INTEN;
-	cr1 &= ~BIT_RFF_OR_INT;
-	cr1 &= ~BIT_FB1_DMA_DONE_INTEN;
-	cr1 &= ~BIT_FB2_DMA_DONE_INTEN;
-	__raw_writel(cr1, csi_dev->regbase + CSI_CSICR1);
+	csi_dev->cr1 &= ~BIT_SOF_INTEN;
+	csi_dev->cr1 &= ~BIT_RFF_OR_INT;
+	csi_dev->cr1 &= ~BIT_FB1_DMA_DONE_INTEN;
+	csi_dev->cr1 &= ~BIT_FB2_DMA_DONE_INTEN;
+	csi_dev->cr_dirty |= CSI_DIRTY_CR1;
 }
 
 static void csi_enable(struct mx6s_csi_dev *csi_dev, int arg)
 {
-	unsigned long cr = __raw_readl(csi_dev->regbase + CSI_CSICR18);
-
 	if (arg == 1)
-		cr |= BIT_CSI_ENABLE;
+		csi_dev->cr18 |= BIT_CSI_ENABLE;
 	else
-		cr &= ~BIT_CSI_ENABLE;
-
-	cr |= BIT_MIPI_DATA_FORMAT_RGB888;
-	cr |= BIT_PARALLEL24_EN;
-	//cr |= RGB888A_FORMAT_SEL;
-	__raw_writel(cr, csi_dev->regbase + CSI_CSICR18);
+		csi_dev->cr18 &= ~BIT_CSI_ENABLE;
 
+	/* The MIPI data format is set by mx6s_configure_csi() */
+	csi_dev->cr_dirty |= CSI_DIRTY_CR18;
 }
 
 static void csi_buf_stride_set(struct mx6s_csi_dev *csi_dev, u32 stride)
@@ -512,121 +569,96 @@ static void csi_buf_stride_set(struct mx6s_csi_dev *csi_dev, u32 stride)
 
 static void csi_deinterlace_enable(struct mx6s_csi_dev *csi_dev, bool enable)
 {
-	unsigned long cr18 = __raw_readl(csi_dev->regbase + CSI_CSICR18);
-
 	if (enable == true)
-		cr18 |= BIT_DEINTERLACE_EN;
+		csi_dev->cr18 |= BIT_DEINTERLACE_EN;
 	else
-		cr18 &= ~BIT_DEINTERLACE_EN;
-
-	__raw_writel(cr18, csi_dev->regbase + CSI_CSICR18);
+		csi_dev->cr18 &= ~BIT_DEINTERLACE_EN;
+	csi_dev->cr_dirty |= CSI_DIRTY_CR18;
 }
 
 static void csi_deinterlace_mode(struct mx6s_csi_dev *csi_dev, int mode)
 {
-	unsigned long cr18 = __raw_readl(csi_dev->regbase + CSI_CSICR18);
-
 	if (mode == V4L2_STD_NTSC)
-		cr18 |= BIT_NTSC_EN;
+		csi_dev->cr18 |= BIT_NTSC_EN;
 	else
-		cr18 &= ~BIT_NTSC_EN;
-
-	__raw_writel(cr18, csi_dev->regbase + CSI_CSICR18);
+		csi_dev->cr18 &= ~BIT_NTSC_EN;
+	csi_dev->cr_dirty |= CSI_DIRTY_CR18;
 }
 
 static void csi_tvdec_enable(struct mx6s_csi_dev *csi_dev, bool enable)
 {
-	unsigned long cr18 = __raw_readl(csi_dev->regbase + CSI_CSICR18);
-	unsigned long cr1 = __raw_readl(csi_dev->regbase + CSI_CSICR1);
-
 	if (enable == true) {
-		cr18 |= (BIT_TVDECODER_IN_EN |
+		csi_dev->cr18 |= (BIT_TVDECODER_IN_EN |
 				BIT_BASEADDR_SWITCH_EN |
 				BIT_BASEADDR_SWITCH_SEL |
 				BIT_BASEADDR_CHG_ERR_EN);
-		cr1 |= BIT_CCIR_MODE;
-		cr1 &= ~(BIT_SOF_POL | BIT_REDGE);
+		csi_dev->cr1 |= BIT_CCIR_MODE;
+		csi_dev->cr1 &= ~(BIT_SOF_POL | BIT_REDGE);
 	} else {
-		cr18 &= ~(BIT_TVDECODER_IN_EN |
+		csi_dev->cr18 &= ~(BIT_TVDECODER_IN_EN |
 				BIT_BASEADDR_SWITCH_EN |
 				BIT_BASEADDR_SWITCH_SEL |
 				BIT_BASEADDR_CHG_ERR_EN);
-		cr1 &= ~BIT_CCIR_MODE;
-		cr1 |= BIT_SOF_POL | BIT_REDGE;
+		csi_dev->cr1 &= ~BIT_CCIR_MODE;
+		csi_dev->cr1 |= BIT_SOF_POL | BIT_REDGE;
 	}
-
-	__raw_writel(cr18, csi_dev->regbase + CSI_CSICR18);
-	__raw_writel(cr1, csi_dev->regbase + CSI_CSICR1);
+	csi_dev->cr_dirty |= CSI_DIRTY_CR18 | CSI_DIRTY_CR1;
 }
 
 static void csi_dmareq_rff_enable(struct mx6s_csi_dev *csi_dev)
 {
-	unsigned long cr3 = __raw_readl(csi_dev->regbase + CSI_CSICR3);
-	unsigned long cr2 = __raw_readl(csi_dev->regbase + CSI_CSICR2);
-
 	/* Burst Type of DMA Transfer from RxFIFO. INCR16 */
-	cr2 |= 0xC0000000;
+	csi_dev->cr2 |= 0xC0000000;
 
-	cr3 |= BIT_DMA_REQ_EN_RFF;
-	cr3 |= BIT_HRESP_ERR_EN;
-	cr3 &= ~BIT_RXFF_LEVEL;
-	cr3 |= 0x2 << 4;
+	csi_dev->cr3 |= BIT_DMA_REQ_EN_RFF;
+	csi_dev->cr3 |= BIT_HRESP_ERR_EN;
+	csi_dev->cr3 &= ~BIT_RXFF_LEVEL;
+	csi_dev->cr3 |= 0x2 << 4;
 	if (csi_dev->csi_two_8bit_sensor_mode)
-		cr3 |= BIT_TWO_8BIT_SENSOR;
+		csi_dev->cr3 |= BIT_TWO_8BIT_SENSOR;
 
-	__raw_writel(cr3, csi_dev->regbase + CSI_CSICR3);
-	__raw_writel(cr2, csi_dev->regbase + CSI_CSICR2);
+	csi_dev->cr_dirty |= CSI_DIRTY_CR3 | CSI_DIRTY_CR2;
 }
 
 static void csi_dmareq_rff_disable(struct mx6s_csi_dev *csi_dev)
 {
-	unsigned long cr3 = __raw_readl(csi_dev->regbase + CSI_CSICR3);
-
-	cr3 &= ~BIT_DMA_REQ_EN_RFF;
-	cr3 &= ~BIT_HRESP_ERR_EN;
-	__raw_writel(cr3, csi_dev->regbase + CSI_CSICR3);
+	csi_dev->cr3 &= ~BIT_DMA_REQ_EN_RFF;
+	csi_dev->cr3 &= ~BIT_HRESP_ERR_EN;
+	csi_dev->cr_dirty |= CSI_DIRTY_CR3;
 }
 
 static void csi_set_imagpara(struct mx6s_csi_dev *csi,
 					int width, int height)
 {
 	int imag_para = 0;
-	unsigned long cr3 = __raw_readl(csi->regbase + CSI_CSICR3);
 
 	imag_para = (width << 16) | height;
 	__raw_writel(imag_para, csi->regbase + CSI_CSIIMAG_PARA);
 
-	/* reflash the embeded DMA controller */
-	__raw_writel(cr3 | BIT_DMA_REFLASH_RFF, csi->regbase + CSI_CSICR3);
+	csi_dma_reflash(csi);
 }
 
 static void csi_error_recovery(struct mx6s_csi_dev *csi_dev)
 {
-	u32 cr1, cr3, cr18;
 	/* software reset */
 
 	/* Disable csi  */
-	cr18 = csi_read(csi_dev, CSI_CSICR18);
-	cr18 &= ~BIT_CSI_ENABLE;
-	csi_write(csi_dev, cr18, CSI_CSICR18);
+	csi_write(csi_dev, csi_dev->cr18 & ~BIT_CSI_ENABLE, CSI_CSICR18);
 
 	/* Clear RX FIFO */
-	cr1 = csi_read(csi_dev, CSI_CSICR1);
-	csi_write(csi_dev, cr1 & ~BIT_FCC, CSI_CSICR1);
-	cr1 = csi_read(csi_dev, CSI_CSICR1);
-	csi_write(csi_dev, cr1 | BIT_CLR_RXFIFO, CSI_CSICR1);
+	csi_write(csi_dev, csi_dev->cr1 & ~BIT_FCC, CSI_CSICR1);
+	csi_write(csi_dev, (csi_dev->cr1 & ~BIT_FCC) | BIT_CLR_RXFIFO,
+		  CSI_CSICR1);
 
-	cr1 = csi_read(csi_dev, CSI_CSICR1);
-	csi_write(csi_dev, cr1 | BIT_FCC, CSI_CSICR1);
+	csi_dev->cr1 |= BIT_FCC;
+	csi_write(csi_dev, csi_dev->cr1, CSI_CSICR1);
 
 	/* DMA reflash */
-	cr3 = csi_read(csi_dev, CSI_CSICR3);
-	cr3 |= BIT_DMA_REFLASH_RFF;
-	csi_write(csi_dev, cr3, CSI_CSICR3);
+	csi_dma_reflash(csi_dev);
 
 	/* Ensable csi  */
-	cr18 |= BIT_CSI_ENABLE;
-	csi_write(csi_dev, cr18, CSI_CSICR18);
+	csi_dev->cr18 |= BIT_CSI_ENABLE;
+	csi_write(csi_dev, csi_dev->cr18, CSI_CSICR18);
 }
 
 /*
@@ -715,17 +747,30 @@ static void mx6s_update_csi_buf(struct mx6s_csi_dev *csi_dev,
 
 static void mx6s_csi_init(struct mx6s_csi_dev *csi_dev)
 {
+	unsigned long flags;
+
 	csi_clk_enable(csi_dev);
+
+	spin_lock_irqsave(&csi_dev->slock, flags);
+	/* CR18 is not touched by the hardware reset, load it once here */
+	csi_dev->cr18 = csi_read(csi_dev, CSI_CSICR18);
 	csihw_reset(csi_dev);
 	csi_init_interface(csi_dev);
 	csi_dmareq_rff_disable(csi_dev);
+	csi_regs_flush(csi_dev);
+	spin_unlock_irqrestore(&csi_dev->slock, flags);
 }
 
 static void mx6s_csi_deinit(struct mx6s_csi_dev *csi_dev)
 {
+	unsigned long flags;
+
+	spin_lock_irqsave(&csi_dev->slock, flags);
 	csihw_reset(csi_dev);
 	csi_init_interface(csi_dev);
 	csi_dmareq_rff_disable(csi_dev);
+	csi_regs_flush(csi_dev);
+	spin_unlock_irqrestore(&csi_dev->slock, flags);
 	csi_clk_disable(csi_dev);
 }
 
@@ -733,29 +778,31 @@ static int mx6s_csi_enable(struct mx6s_csi_dev *csi_dev)
 {
 	struct v4l2_pix_format *pix = &csi_dev->pix;
 	unsigned long flags;
-	unsigned long val;
 	int timeout, timeout2;
 
 	csi_dev->skipframe = 3;
 	csisw_reset(csi_dev);
 
-	if (pix->field == V4L2_FIELD_INTERLACED)
+	spin_lock_irqsave(&csi_dev->slock, flags);
+	if (pix->field == V4L2_FIELD_INTERLACED) {
 		csi_tvdec_enable(csi_dev, true);
+		/* CCIR mode has to be on before waiting for SOF below */
+		csi_regs_flush(csi_dev);
+	}
 
 	/* For mipi csi input only */
 	if (csi_dev->csi_mipi_mode == true) {
 		csi_dmareq_rff_enable(csi_dev);
 		csi_enable_int(csi_dev, 1);
 		csi_enable(csi_dev, 1);
+		csi_regs_flush(csi_dev);
+		spin_unlock_irqrestore(&csi_dev->slock, flags);
 		return 0;
 	}
 
-	local_irq_save(flags);
 	for (timeout = 10000000; timeout > 0; timeout--) {
 		if (csi_read(csi_dev, CSI_CSISR) & BIT_SOF_INT) {
-			val = csi_read(csi_dev, CSI_CSICR3);
-			csi_write(csi_dev, val | BIT_DMA_REFLASH_RFF,
-					CSI_CSICR3);
+			csi_dma_reflash(csi_dev);
 			/* Wait DMA reflash done */
 			for (timeout2 = 1000000; timeout2 > 0; timeout2--) {
 				if (csi_read(csi_dev, CSI_CSICR3) &
@@ -766,7 +813,7 @@ static int mx6s_csi_enable(struct mx6s_csi_dev *csi_dev)
 			}
 			if (timeout2 <= 0) {
 				pr_err("timeout when wait for reflash done.\n");
-				local_irq_restore(flags);
+				spin_unlock_irqrestore(&csi_dev->slock, flags);
 				return -ETIME;
 			}
 			/* For imx6sl csi, DMA FIFO will auto start when sensor ready to work,
@@ -776,16 +823,17 @@ static int mx6s_csi_enable(struct mx6s_csi_dev *csi_dev)
 			csi_dmareq_rff_enable(csi_dev);
 			csi_enable_int(csi_dev, 1);
 			csi_enable(csi_dev, 1);
+			csi_regs_flush(csi_dev);
 			break;
 		} else
 			cpu_relax();
 	}
 	if (timeout <= 0) {
 		pr_err("timeout when wait for SOF\n");
-		local_irq_restore(flags);
+		spin_unlock_irqrestore(&csi_dev->slock, flags);
 		return -ETIME;
 	}
-	local_irq_restore(flags);
+	spin_unlock_irqrestore(&csi_dev->slock, flags);
 
 	return 0;
 }
@@ -793,7 +841,9 @@ static int mx6s_csi_enable(struct mx6s_csi_dev *csi_dev)
 static void mx6s_csi_disable(struct mx6s_csi_dev *csi_dev)
 {
 	struct v4l2_pix_format *pix = &csi_dev->pix;
+	unsigned long flags;
 
+	spin_lock_irqsave(&csi_dev->slock, flags);
 	csi_dmareq_rff_disable(csi_dev);
 	csi_disable_int(csi_dev);
 
@@ -809,14 +859,19 @@ static void mx6s_csi_disable(struct mx6s_csi_dev *csi_dev)
 	}
 
 	csi_enable(csi_dev, 0);
+	csi_regs_flush(csi_dev);
+	spin_unlock_irqrestore(&csi_dev->slock, flags);
 }
 
 static int mx6s_configure_csi(struct mx6s_csi_dev *csi_dev)
 {
 	struct v4l2_pix_format *pix = &csi_dev->pix;
-	u32 cr1, cr18;
+	unsigned long flags;
+	int ret = 0;
+	u32 cr18;
 	u32 width;
 
+	spin_lock_irqsave(&csi_dev->slock, flags);
 	if (pix->field == V4L2_FIELD_INTERLACED) {
 		csi_deinterlace_enable(csi_dev, true);
 		csi_buf_stride_set(csi_dev, csi_dev->pix.width);
@@ -844,17 +899,17 @@ static int mx6s_configure_csi(struct mx6s_csi_dev *csi_dev)
 		break;
 	default:
 		pr_debug("   case not supported\n");
-		return -EINVAL;
+		ret = -EINVAL;
+		goto out;
 	}
 	csi_set_imagpara(csi_dev, width, pix->height);
 
 	if (csi_dev->csi_mipi_mode == true) {
-		cr1 = csi_read(csi_dev, CSI_CSICR1);
-		cr1 &= ~BIT_GCLK_MODE;
-		csi_write(csi_dev, cr1, CSI_CSICR1);
+		csi_dev->cr1 &= ~BIT_GCLK_MODE;
+		csi_dev->cr_dirty |= CSI_DIRTY_CR1;
 
-		cr18 = csi_read(csi_dev, CSI_CSICR18);
-		cr18 &= ~BIT_MIPI_DATA_FORMAT_MASK;
+		cr18 = csi_dev->cr18;
+		cr18 &= ~(BIT_MIPI_DATA_FORMAT_MASK | BIT_PARALLEL24_EN);
 		cr18 |= BIT_DATA_FROM_MIPI;
 
 		switch (csi_dev->fmt->pixelformat) {
@@ -872,12 +927,17 @@ static int mx6s_configure_csi(struct mx6s_csi_dev *csi_dev)
 			break;
 		default:
 			pr_debug("   fmt not supported\n");
-			return -EINVAL;
+			ret = -EINVAL;
+			goto out;
 		}
 
-		csi_write(csi_dev, cr18, CSI_CSICR18);
+		csi_dev->cr18 = cr18;
+		csi_dev->cr_dirty |= CSI_DIRTY_CR18;
 	}
-	return 0;
+out:
+	csi_regs_flush(csi_dev);
+	spin_unlock_irqrestore(&csi_dev->slock, flags);
+	return ret;
 }
 
 static int mx6s_start_streaming(struct vb2_queue *vq, unsigned int count)
@@ -1040,7 +1100,7 @@ static void mx6s_csi_frame_done(struct mx6s_csi_dev *csi_dev,
 		list_del_init(&buf->internal.queue);
 		vb->timestamp =ktime_get_ns();
 		to_vb2_v4l2_buffer(vb)->sequence = csi_dev->frame_count;
-		if (err)
+		if (err || csi_dev->no_signal)
 			vb2_buffer_done(vb, VB2_BUF_STATE_ERROR);
 		else
 			vb2_buffer_done(vb, VB2_BUF_STATE_DONE);
@@ -1083,11 +1143,29 @@ static void mx6s_csi_frame_done(struct mx6s_csi_dev *csi_dev,
 	mx6s_update_csi_buf(csi_dev, phys, bufnum);
 }
 
+/*
+ * Notifications of the subdevs bound to our v4l2_device. Frames that
+ * arrive while the decoder reports no signal are returned with
+ * V4L2_BUF_FLAG_ERROR set.
+ */
+static void mx6s_csi_notify(struct v4l2_subdev *sd, unsigned int notification,
+			    void *arg)
+{
+	struct mx6s_csi_dev *csi_dev = container_of(sd->v4l2_dev,
+					struct mx6s_csi_dev, v4l2_dev);
+	unsigned long flags;
+
+	if (notification != ADV7482_NOTIFY_NO_SIGNAL)
+		return;
+	spin_lock_irqsave(&csi_dev->slock, flags);
+	csi_dev->no_signal = *(bool *)arg;
+	spin_unlock_irqrestore(&csi_dev->slock, flags);
+}
+
 static irqreturn_t mx6s_csi_irq_handler(int irq, void *data)
 {
 	struct mx6s_csi_dev *csi_dev =  data;
 	unsigned long status;
-	u32 cr3, cr18;
 
 	spin_lock(&csi_dev->slock);
 
@@ -1117,18 +1195,14 @@ static irqreturn_t mx6s_csi_irq_handler(int irq, void *data)
 
 	if (status & BIT_ADDR_CH_ERR_INT) {
 		/* Disable csi  */
-		cr18 = csi_read(csi_dev, CSI_CSICR18);
-		cr18 &= ~BIT_CSI_ENABLE;
-		csi_write(csi_dev, cr18, CSI_CSICR18);
+		csi_write(csi_dev, csi_dev->cr18 & ~BIT_CSI_ENABLE, CSI_CSICR18);
 
 		/* DMA reflash */
-		cr3 = csi_read(csi_dev, CSI_CSICR3);
-		cr3 |= BIT_DMA_REFLASH_RFF;
-		csi_write(csi_dev, cr3, CSI_CSICR3);
+		csi_dma_reflash(csi_dev);
 
 		/* Ensable csi  */
-		cr18 |= BIT_CSI_ENABLE;
-		csi_write(csi_dev, cr18, CSI_CSICR18);
+		csi_dev->cr18 |= BIT_CSI_ENABLE;
+		csi_write(csi_dev, csi_dev->cr18, CSI_CSICR18);
 
 		csi_dev->skipframe++;
 		pr_debug("base address switching Change Err.\n");
@@ -1174,7 +1248,6 @@ static irqreturn_t mx6s_csi_irq_handler(int irq, void *data)
 static int mx6s_csi_open(struct file *file)
 {
 	struct mx6s_csi_dev *csi_dev = video_drvdata(file);
-	struct v4l2_subdev *sd = csi_dev->sd;
 	struct vb2_queue *q = &csi_dev->vb2_vidq;
 	int ret = 0;
 
@@ -1197,13 +1270,11 @@ static int mx6s_csi_open(struct file *file)
 		if (ret < 0)
 			goto unlock;
 
-		pm_runtime_get_sync(csi_dev->dev);
-
-		request_bus_freq(BUS_FREQ_HIGH);
-
-		v4l2_subdev_call(sd, core, s_power, 1);
-		mx6s_csi_init(csi_dev);
-
+		ret = pm_runtime_resume_and_get(csi_dev->dev);
+		if (ret < 0) {
+			csi_dev->open_count--;
+			goto unlock;
+		}
 	}
 	mutex_unlock(&csi_dev->lock);
 
@@ -1216,21 +1287,20 @@ unlock:
 static int mx6s_csi_close(struct file *file)
 {
 	struct mx6s_csi_dev *csi_dev = video_drvdata(file);
-	struct v4l2_subdev *sd = csi_dev->sd;
 
 	mutex_lock(&csi_dev->lock);
 
 	if (--csi_dev->open_count == 0) {
 		vb2_queue_release(&csi_dev->vb2_vidq);
 
-		mx6s_csi_deinit(csi_dev);
-		v4l2_subdev_call(sd, core, s_power, 0);
-
 		file->private_data = NULL;
 
-		release_bus_freq(BUS_FREQ_HIGH);
-
-		pm_runtime_put_sync_suspend(csi_dev->dev);
+		/*
+		 * Keep the CSI, the bus frequency and the subdevs powered for
+		 * a while, a new session often follows right away.
+		 */
+		pm_runtime_mark_last_busy(csi_dev->dev);
+		pm_runtime_put_autosuspend(csi_dev->dev);
 	}
 	mutex_unlock(&csi_dev->lock);
 
@@ -1265,30 +1335,75 @@ static struct v4l2_file_operations mx6s_csi_fops = {
 /*
  * Video node IOCTLs
  */
+/* Inputs of the decoder, indexed by its s_routing input number */
+static const struct v4l2_input mx6s_inputs[] = {
+	{
+		.name = "HDMI",
+		.type = V4L2_INPUT_TYPE_CAMERA,
+	}, {
+		.name = "CVBS",
+		.type = V4L2_INPUT_TYPE_CAMERA,
+		.std = V4L2_STD_ALL,
+	},
+};
+
 static int mx6s_vidioc_enum_input(struct file *file, void *priv,
 				 struct v4l2_input *inp)
 {
-	if (inp->index != 0)
+	u32 index = inp->index;
+
+	if (index >= ARRAY_SIZE(mx6s_inputs))
 		return -EINVAL;
 
-	/* default is camera */
-	inp->type = V4L2_INPUT_TYPE_CAMERA;
-	strcpy(inp->name, "Camera");
+	*inp = mx6s_inputs[index];
+	inp->index = index;
 
 	return 0;
 }
 
+/*
+ * The decoder starts on the input its DT selects, so take the route
+ * from it rather than assuming HDMI. Called with csi_dev->lock held.
+ */
+static void mx6s_csi_sync_input(struct mx6s_csi_dev *csi_dev)
+{
+	u32 route;
+
+	if (!v4l2_subdev_call(csi_dev->sd, core, ioctl, ADV7482_G_ROUTING,
+			      &route) && route < ARRAY_SIZE(mx6s_inputs))
+		csi_dev->input = route;
+}
+
 static int mx6s_vidioc_g_input(struct file *file, void *priv, unsigned int *i)
 {
-	*i = 0;
+	struct mx6s_csi_dev *csi_dev = video_drvdata(file);
+
+	mx6s_csi_sync_input(csi_dev);
+	*i = csi_dev->input;
 
 	return 0;
 }
 
 static int mx6s_vidioc_s_input(struct file *file, void *priv, unsigned int i)
 {
-	if (i > 0)
+	struct mx6s_csi_dev *csi_dev = video_drvdata(file);
+	int ret;
+
+	if (i >= ARRAY_SIZE(mx6s_inputs))
 		return -EINVAL;
+	mx6s_csi_sync_input(csi_dev);
+	if (i == csi_dev->input)
+		return 0;
+	/* The lane count and format may change with the input */
+	if (vb2_is_busy(&csi_dev->vb2_vidq))
+		return -EBUSY;
+
+	ret = v4l2_subdev_call(csi_dev->sd, video, s_routing, i, 0, 0);
+	if (ret == -ENOIOCTLCMD)
+		return -EINVAL;
+	if (ret)
+		return ret;
+	csi_dev->input = i;
 
 	return 0;
 }
@@ -1434,9 +1549,15 @@ static int mx6s_vidioc_try_fmt_vid_cap(struct file *file, void *priv,
 	pix->sizeimage = fmt->bpp * pix->height * pix->width;
 	pix->bytesperline = fmt->bpp * pix->width;
 
-	pix->colorspace = V4L2_COLORSPACE_SRGB;
+	if (fmt->pixelformat == V4L2_PIX_FMT_UYVY) {
+		/* CVBS from the SDP */
+		pix->colorspace = V4L2_COLORSPACE_SMPTE170M;
+		pix->quantization = V4L2_QUANTIZATION_LIM_RANGE;
+	} else {
+		pix->colorspace = V4L2_COLORSPACE_SRGB;
+		pix->quantization = V4L2_QUANTIZATION_FULL_RANGE;
+	}
 	pix->ycbcr_enc = V4L2_MAP_YCBCR_ENC_DEFAULT(pix->colorspace);
-	pix->quantization = V4L2_QUANTIZATION_FULL_RANGE;
 
 	return ret;
 }
@@ -1596,8 +1717,24 @@ static int mx6s_vidioc_g_parm(struct file *file, void *priv,
 {
 	struct mx6s_csi_dev *csi_dev = video_drvdata(file);
 	struct v4l2_subdev *sd = csi_dev->sd;
+	struct v4l2_subdev_frame_interval fi = { .pad = 0 };
+	int ret;
+
+	if (a->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+		return -EINVAL;
+
+	/* Sources that measure their input report the real rate here */
+	ret = v4l2_subdev_call(sd, video, g_frame_interval, &fi);
+	if (ret == -ENOIOCTLCMD)
+		return v4l2_subdev_call(sd, video, g_parm, a);
+	if (ret)
+		return ret;
+
+	memset(&a->parm.capture, 0, sizeof(a->parm.capture));
+	a->parm.capture.capability = V4L2_CAP_TIMEPERFRAME;
+	a->parm.capture.timeperframe = fi.interval;
 
-	return v4l2_subdev_call(sd, video, g_parm, a);
+	return 0;
 }
 
 static int mx6s_vidioc_s_parm(struct file *file, void *priv,
@@ -1898,6 +2035,7 @@ static int mx6s_csi_probe(struct platform_device *pdev)
 	snprintf(csi_dev->v4l2_dev.name,
 		 sizeof(csi_dev->v4l2_dev.name), "CSI");
 
+	csi_dev->v4l2_dev.notify = mx6s_csi_notify;
 	ret = v4l2_device_register(dev, &csi_dev->v4l2_dev);
 	if (ret < 0) {
 		dev_err(dev, "v4l2_device_register() failed: %d\n", ret);
@@ -1953,6 +2091,8 @@ static int mx6s_csi_probe(struct platform_device *pdev)
 	if (ret < 0)
 		goto err_irq;
 
+	pm_runtime_set_autosuspend_delay(csi_dev->dev, autosuspend_delay_ms);
+	pm_runtime_use_autosuspend(csi_dev->dev);
 	pm_runtime_enable(csi_dev->dev);
 	return 0;
 
@@ -1963,31 +2103,55 @@ err_vdev:
 	return ret;
 }
 
-static int mx6s_csi_remove(struct platform_device *pdev)
+static int mx6s_csi_runtime_suspend(struct device *dev)
 {
-	struct v4l2_device *v4l2_dev = dev_get_drvdata(&pdev->dev);
+	struct v4l2_device *v4l2_dev = dev_get_drvdata(dev);
 	struct mx6s_csi_dev *csi_dev =
 				container_of(v4l2_dev, struct mx6s_csi_dev, v4l2_dev);
 
-	v4l2_async_nf_cleanup(&csi_dev->subdev_notifier);
-	v4l2_async_nf_unregister(&csi_dev->subdev_notifier);
-
-	video_unregister_device(csi_dev->vdev);
-	v4l2_device_unregister(&csi_dev->v4l2_dev);
+	mx6s_csi_deinit(csi_dev);
+	v4l2_subdev_call(csi_dev->sd, core, s_power, 0);
 
-	pm_runtime_disable(csi_dev->dev);
+	dev_dbg(dev, "csi v4l2 busfreq high release.\n");
+	release_bus_freq(BUS_FREQ_HIGH);
 	return 0;
 }
 
-static int mx6s_csi_runtime_suspend(struct device *dev)
+static int mx6s_csi_runtime_resume(struct device *dev)
 {
-	dev_dbg(dev, "csi v4l2 busfreq high release.\n");
+	struct v4l2_device *v4l2_dev = dev_get_drvdata(dev);
+	struct mx6s_csi_dev *csi_dev =
+				container_of(v4l2_dev, struct mx6s_csi_dev, v4l2_dev);
+
+	dev_dbg(dev, "csi v4l2 busfreq high request.\n");
+	request_bus_freq(BUS_FREQ_HIGH);
+
+	v4l2_subdev_call(csi_dev->sd, core, s_power, 1);
+	mx6s_csi_init(csi_dev);
 	return 0;
 }
 
-static int mx6s_csi_runtime_resume(struct device *dev)
+static int mx6s_csi_remove(struct platform_device *pdev)
 {
-	dev_dbg(dev, "csi v4l2 busfreq high request.\n");
+	struct v4l2_device *v4l2_dev = dev_get_drvdata(&pdev->dev);
+	struct mx6s_csi_dev *csi_dev =
+				container_of(v4l2_dev, struct mx6s_csi_dev, v4l2_dev);
+
+	/*
+	 * An autosuspend may still be pending, suspend now while the
+	 * sensor is bound so that its s_power(0) goes out too.
+	 */
+	pm_runtime_dont_use_autosuspend(csi_dev->dev);
+	pm_runtime_disable(csi_dev->dev);
+	if (!pm_runtime_status_suspended(csi_dev->dev))
+		mx6s_csi_runtime_suspend(csi_dev->dev);
+	pm_runtime_set_suspended(csi_dev->dev);
+
+	v4l2_async_nf_cleanup(&csi_dev->subdev_notifier);
+	v4l2_async_nf_unregister(&csi_dev->subdev_notifier);
+
+	video_unregister_device(csi_dev->vdev);
+	v4l2_device_unregister(&csi_dev->v4l2_dev);
 	return 0;
 }
 
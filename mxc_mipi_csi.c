@@ -38,11 +38,24 @@
 #include <linux/videodev2.h>
 #include <media/v4l2-subdev.h>
 #include <media/v4l2-device.h>
+#include <media/v4l2-ioctl.h>
+#include <media/videobuf2-v4l2.h>
+#include <media/videobuf2-vmalloc.h>
 
 static int debug;
 module_param(debug, int, 0644);
 MODULE_PARM_DESC(debug, "Debug level (0-2)");
 
+static int autosuspend_delay_ms = 2000;
+module_param(autosuspend_delay_ms, int, 0444);
+MODULE_PARM_DESC(autosuspend_delay_ms,
+		 "Idle time before the receiver is powered down (ms, -1 = never)");
+
+static unsigned int embedded_data_size = 256;
+module_param(embedded_data_size, uint, 0444);
+MODULE_PARM_DESC(embedded_data_size,
+		 "Bytes of embedded data captured per packet (4-4096)");
+
 #define CSIS_DRIVER_NAME	"mxc_mipi-csi"
 #define CSIS_SUBDEV_NAME	CSIS_DRIVER_NAME
 #define CSIS_MAX_ENTITIES	2
@@ -185,6 +198,11 @@ MODULE_PARM_DESC(debug, "Debug level (0-2)");
 #define MIPI_CSIS_PKTDATA_EVEN		0x3000
 #define MIPI_CSIS_PKTDATA_SIZE		SZ_4K
 
+/* Embedded data ring, must be a power of two */
+#define MIPI_CSIS_META_RING_SIZE	8
+/* Raw CSI-2 embedded data, as found in the packet data buffers */
+#define MIPI_CSIS_META_FMT_EMBEDDED	v4l2_fourcc('C', 'S', 'E', 'D')
+
 #define DEFAULT_SCLK_CSIS_FREQ	166000000UL
 
 enum {
@@ -225,6 +243,66 @@ struct csis_pktbuf {
 	unsigned int len;
 };
 
+/**
+ * struct csis_meta_slot - one embedded data packet captured by the IRQ handler
+ * @frame: frame number the packet belongs to, counted from stream start
+ * @timestamp: CLOCK_MONOTONIC time the packet was received
+ * @len: number of valid bytes in @data
+ * @data: packet payload
+ */
+struct csis_meta_slot {
+	u32 frame;
+	u64 timestamp;
+	unsigned int len;
+	u32 data[MIPI_CSIS_PKTDATA_SIZE / sizeof(u32)];
+};
+
+struct csis_meta_buffer {
+	struct vb2_v4l2_buffer vb;
+	struct list_head list;
+};
+
+/**
+ * struct csis_hw_config - receiver configuration last written to the hardware
+ * @fmt_reg: MIPI_CSIS_ISPCONFIG_CH0 data format
+ * @data_alignment: MIPI-CSI data alignment in bits
+ * @width: programmed frame width
+ * @height: programmed frame height
+ * @num_lanes: programmed number of data lanes
+ * @hs_settle: programmed HS-RX settle time
+ * @clk_settle: programmed Clk settle time
+ * @wclk_ext: programmed wrapper clock source
+ */
+struct csis_hw_config {
+	u32 fmt_reg;
+	u32 data_alignment;
+	u32 width;
+	u32 height;
+	u32 num_lanes;
+	u32 hs_settle;
+	u32 clk_settle;
+	u32 wclk_ext;
+};
+
+/**
+ * struct csis_ctrl_regs - software copy of the receiver control registers
+ * @cmn_ctrl: MIPI_CSIS_CMN_CTRL
+ * @clk_ctrl: MIPI_CSIS_CLK_CTRL
+ * @intmsk: MIPI_CSIS_INTMSK
+ * @dphyctrl: MIPI_CSIS_DPHYCTRL
+ * @ispconfig: MIPI_CSIS_ISPCONFIG_CH0
+ *
+ * Loaded once after a software reset, then updated in memory and written
+ * out without reading the hardware back.
+ */
+struct csis_ctrl_regs {
+	u32 cmn_ctrl;
+	u32 clk_ctrl;
+	u32 intmsk;
+	u32 dphyctrl;
+	u32 ispconfig;
+};
+
 struct csis_hw_reset {
 	struct regmap *src;
 	u8 req_src;
@@ -248,13 +326,30 @@ struct csis_hw_reset {
  * @hs_settle: HS-RX settle time
  * @clk_settle: Clk settle time
  * @num_lanes: number of MIPI-CSI data lanes used
+ * @dt_num_lanes: number of MIPI-CSI data lanes wired on the board
  * @max_num_lanes: maximum number of MIPI-CSI data lanes supported
  * @wclk_ext: CSI wrapper clock: 0 - bus clock, 1 - external SCLK_CAM
  * @csis_fmt: current CSIS pixel format
  * @format: common media bus format for the source and sink pad
+ * @regs: control register values last written to the receiver
+ * @hw_cfg: configuration last programmed into the receiver
+ * @hw_cfg_valid: @hw_cfg matches the hardware, a restart may skip the reset
  * @slock: spinlock protecting structure members below
  * @pkt_buf: the frame embedded (non-image) data buffer
  * @events: MIPI-CSIS event (error) counters
+ * @frame_seq: number of frame start events since the stream was started
+ * @meta_ring: preallocated embedded data slots, filled by the IRQ handler
+ * @meta_head: index of the next slot to fill
+ * @meta_tail: index of the oldest slot not yet handed to userspace
+ * @meta_len: bytes of embedded data copied per packet
+ * @meta_dropped: slots overwritten before userspace dequeued them
+ * @meta_streaming: the metadata video node is streaming
+ * @meta_bufs: metadata buffers queued by userspace
+ * @meta_copy: slot being copied into a buffer, never refilled meanwhile
+ * @meta_drain_lock: serializes mipi_csis_meta_drain()
+ * @meta_vdev: metadata capture video node
+ * @meta_queue: vb2 queue of @meta_vdev
+ * @meta_lock: serializes the @meta_vdev ioctls
  */
 struct csi_state {
 	struct mutex lock;
@@ -278,16 +373,35 @@ struct csi_state {
 	u32 hs_settle;
 	u32 clk_settle;
 	u32 num_lanes;
+	u32 dt_num_lanes;
 	u32 max_num_lanes;
 	u8 wclk_ext;
 
 	const struct csis_pix_format *csis_fmt;
 	struct v4l2_mbus_framefmt format;
+	struct csis_ctrl_regs regs;
+	struct csis_hw_config hw_cfg;
+	bool hw_cfg_valid;
 
 	spinlock_t slock;
 	struct csis_pktbuf pkt_buf;
 	struct mipi_csis_event events[MIPI_CSIS_NUM_EVENTS];
 
+	u32 frame_seq;
+	struct csis_meta_slot *meta_ring;
+	unsigned int meta_head;
+	unsigned int meta_tail;
+	unsigned int meta_len;
+	unsigned int meta_dropped;
+	bool meta_streaming;
+	struct list_head meta_bufs;
+	struct csis_meta_slot *meta_copy;
+	struct mutex meta_drain_lock;
+
+	struct video_device meta_vdev;
+	struct vb2_queue meta_queue;
+	struct mutex meta_lock;
+
 	struct fwnode_handle *fwnode;
 	struct v4l2_async_notifier  subdev_notifier;
 
@@ -316,6 +430,10 @@ static const struct csis_pix_format mipi_csis_formats[] = {
 		.code = MEDIA_BUS_FMT_RGB888_1X24,
 		.fmt_reg = MIPI_CSIS_ISPCFG_FMT_RGB888_24BIT ,
 		.data_alignment = 24,
+	}, {
+		.code = MEDIA_BUS_FMT_UYVY8_2X8,
+		.fmt_reg = MIPI_CSIS_ISPCFG_FMT_YCBCR422_8BIT,
+		.data_alignment = 16,
 	}
 
 };
@@ -348,12 +466,22 @@ static const struct csis_pix_format *find_csis_format(u32 code)
 
 static void mipi_csis_enable_interrupts(struct csi_state *state, bool on)
 {
-	u32 val = mipi_csis_read(state, MIPI_CSIS_INTMSK);
 	if (on)
-		val |= 0xf00fffff;
+		state->regs.intmsk |= 0xf00fffff;
 	else
-		val &= ~0xf00fffff;
-	mipi_csis_write(state, MIPI_CSIS_INTMSK, val);
+		state->regs.intmsk &= ~0xf00fffff;
+	mipi_csis_write(state, MIPI_CSIS_INTMSK, state->regs.intmsk);
+}
+
+static void mipi_csis_regs_load(struct csi_state *state)
+{
+	struct csis_ctrl_regs *regs = &state->regs;
+
+	regs->cmn_ctrl = mipi_csis_read(state, MIPI_CSIS_CMN_CTRL);
+	regs->clk_ctrl = mipi_csis_read(state, MIPI_CSIS_CLK_CTRL);
+	regs->intmsk = mipi_csis_read(state, MIPI_CSIS_INTMSK);
+	regs->dphyctrl = mipi_csis_read(state, MIPI_CSIS_DPHYCTRL);
+	regs->ispconfig = mipi_csis_read(state, MIPI_CSIS_ISPCONFIG_CH0);
 }
 
 static void mipi_csis_sw_reset(struct csi_state *state)
@@ -362,6 +490,9 @@ static void mipi_csis_sw_reset(struct csi_state *state)
 
 	mipi_csis_write(state, MIPI_CSIS_CMN_CTRL, val | MIPI_CSIS_CMN_CTRL_RESET);
 	udelay(10);
+
+	/* The registers are back to their reset values */
+	mipi_csis_regs_load(state);
 }
 
 static int mipi_csis_phy_init(struct csi_state *state)
@@ -438,94 +569,78 @@ static int mipi_csis_phy_reset(struct csi_state *state)
 
 static void mipi_csis_system_enable(struct csi_state *state, int on)
 {
-	u32 val, mask;
+	struct csis_ctrl_regs *regs = &state->regs;
+	u32 mask;
 
-	val = mipi_csis_read(state, MIPI_CSIS_CMN_CTRL);
 	if (on)
-		val |= MIPI_CSIS_CMN_CTRL_ENABLE;
+		regs->cmn_ctrl |= MIPI_CSIS_CMN_CTRL_ENABLE;
 	else
-		val &= ~MIPI_CSIS_CMN_CTRL_ENABLE;
-	mipi_csis_write(state, MIPI_CSIS_CMN_CTRL, val);
+		regs->cmn_ctrl &= ~MIPI_CSIS_CMN_CTRL_ENABLE;
+	mipi_csis_write(state, MIPI_CSIS_CMN_CTRL, regs->cmn_ctrl);
 
-	val = mipi_csis_read(state, MIPI_CSIS_DPHYCTRL);
-	val &= ~MIPI_CSIS_DPHYCTRL_ENABLE;
+	regs->dphyctrl &= ~MIPI_CSIS_DPHYCTRL_ENABLE;
 	if (on) {
 		mask = (1 << (state->num_lanes + 1)) - 1;
-		val |= (mask & MIPI_CSIS_DPHYCTRL_ENABLE);
+		regs->dphyctrl |= (mask & MIPI_CSIS_DPHYCTRL_ENABLE);
 	}
-	mipi_csis_write(state, MIPI_CSIS_DPHYCTRL, val);
+	mipi_csis_write(state, MIPI_CSIS_DPHYCTRL, regs->dphyctrl);
 }
 
 /* Called with the state.lock mutex held */
-static void __mipi_csis_set_format(struct csi_state *state)
+static void mipi_csis_set_params(struct csi_state *state)
 {
+	struct csis_ctrl_regs *regs = &state->regs;
 	struct v4l2_mbus_framefmt *mf = &state->format;
 	u32 val;
 
 	v4l2_dbg(1, debug, &state->mipi_sd, "fmt: %#x, %d x %d\n",
 		 mf->code, mf->width, mf->height);
 
-	/* Color format */
-	val = mipi_csis_read(state, MIPI_CSIS_ISPCONFIG_CH0);
-	val = (val & ~MIPI_CSIS_ISPCFG_FMT_MASK) | state->csis_fmt->fmt_reg;
-	mipi_csis_write(state, MIPI_CSIS_ISPCONFIG_CH0, val);
-
-	/* Pixel resolution */
-	val = mf->width | (mf->height << 16);
-	mipi_csis_write(state, MIPI_CSIS_ISPRESOL_CH0, val);
-}
-
-static void mipi_csis_set_hsync_settle(struct csi_state *state,
-								int hs_settle, int clk_settle)
-{
-	u32 val = mipi_csis_read(state, MIPI_CSIS_DPHYCTRL);
-
-	val = (val & ~MIPI_CSIS_DPHYCTRL_HSS_MASK) |
-				(hs_settle << 24) | (clk_settle << 22);
+	/* Compute the new register image first ... */
+	regs->cmn_ctrl &= ~MIPI_CSIS_CMN_CTRL_LANE_NR_MASK;
+	regs->cmn_ctrl |= (state->num_lanes - 1) << MIPI_CSIS_CMN_CTRL_LANE_NR_OFFSET;
+	regs->cmn_ctrl |= MIPI_CSIS_CMN_CTRL_UPDATE_SHADOW_CTRL;
 
-	mipi_csis_write(state, MIPI_CSIS_DPHYCTRL, val);
-}
+	/* Color format */
+	regs->ispconfig &= ~(MIPI_CSIS_ISPCFG_FMT_MASK | MIPI_CSIS_ISPCFG_ALIGN_32BIT);
+	regs->ispconfig |= state->csis_fmt->fmt_reg;
+	if (state->csis_fmt->data_alignment == 32)
+		regs->ispconfig |= MIPI_CSIS_ISPCFG_ALIGN_32BIT;
 
-static void mipi_csis_set_params(struct csi_state *state)
-{
-	u32 val;
+	regs->dphyctrl &= ~(MIPI_CSIS_DPHYCTRL_HSS_MASK |
+			    MIPI_CSIS_DPHYCTRL_SCLKS_MASK);
+	regs->dphyctrl |= (state->hs_settle << MIPI_CSIS_DPHYCTRL_HSS_OFFSET) |
+			  (state->clk_settle << MIPI_CSIS_DPHYCTRL_SCLKS_OFFSET);
 
-	val = mipi_csis_read(state, MIPI_CSIS_CMN_CTRL);
-	val &= ~MIPI_CSIS_CMN_CTRL_LANE_NR_MASK;
-	val |= (state->num_lanes - 1) << MIPI_CSIS_CMN_CTRL_LANE_NR_OFFSET;
-	mipi_csis_write(state, MIPI_CSIS_CMN_CTRL, val);
+	regs->clk_ctrl &= ~(MIPI_CSIS_CLK_CTRL_WCLK_SRC |
+			    MIPI_CSIS_CLK_CTRL_CLKGATE_EN_MSK);
+	if (state->wclk_ext)
+		regs->clk_ctrl |= MIPI_CSIS_CLK_CTRL_WCLK_SRC;
+	regs->clk_ctrl |= MIPI_CSIS_CLK_CTRL_CLKGATE_TRAIL_CH0(15);
 
-	__mipi_csis_set_format(state);
+	/* ... then write it out in one pass */
+	mipi_csis_write(state, MIPI_CSIS_CMN_CTRL, regs->cmn_ctrl);
+	mipi_csis_write(state, MIPI_CSIS_ISPCONFIG_CH0, regs->ispconfig);
 
-	mipi_csis_set_hsync_settle(state, state->hs_settle, state->clk_settle);
+	/* Pixel resolution */
+	val = mf->width | (mf->height << 16);
+	mipi_csis_write(state, MIPI_CSIS_ISPRESOL_CH0, val);
 
-	val = mipi_csis_read(state, MIPI_CSIS_ISPCONFIG_CH0);
-	if (state->csis_fmt->data_alignment == 32)
-		val |= MIPI_CSIS_ISPCFG_ALIGN_32BIT;
-	else /* Normal output */
-		val &= ~MIPI_CSIS_ISPCFG_ALIGN_32BIT;
-	mipi_csis_write(state, MIPI_CSIS_ISPCONFIG_CH0, val);
+	mipi_csis_write(state, MIPI_CSIS_DPHYCTRL, regs->dphyctrl);
 
 	val = (0 << MIPI_CSIS_ISPSYNC_HSYNC_LINTV_OFFSET) |
 		(0 << MIPI_CSIS_ISPSYNC_VSYNC_SINTV_OFFSET) |
 		(0 << MIPI_CSIS_ISPSYNC_VSYNC_EINTV_OFFSET);
 	mipi_csis_write(state, MIPI_CSIS_ISPSYNC_CH0, val);
 
-	val = mipi_csis_read(state, MIPI_CSIS_CLK_CTRL);
-	val &= ~MIPI_CSIS_CLK_CTRL_WCLK_SRC;
-	if (state->wclk_ext)
-		val |= MIPI_CSIS_CLK_CTRL_WCLK_SRC;
-	val |= MIPI_CSIS_CLK_CTRL_CLKGATE_TRAIL_CH0(15);
-	val &= ~MIPI_CSIS_CLK_CTRL_CLKGATE_EN_MSK;
-	mipi_csis_write(state, MIPI_CSIS_CLK_CTRL, val);
+	mipi_csis_write(state, MIPI_CSIS_CLK_CTRL, regs->clk_ctrl);
 
 	mipi_csis_write(state, MIPI_CSIS_DPHYBCTRL_L, 0x1f4);
 	mipi_csis_write(state, MIPI_CSIS_DPHYBCTRL_H, 0);
 
-	/* Update the shadow register. */
-	val = mipi_csis_read(state, MIPI_CSIS_CMN_CTRL);
-	mipi_csis_write(state, MIPI_CSIS_CMN_CTRL, val | MIPI_CSIS_CMN_CTRL_UPDATE_SHADOW |
-					MIPI_CSIS_CMN_CTRL_UPDATE_SHADOW_CTRL);
+	/* Latch the new configuration into the hardware shadow registers. */
+	mipi_csis_write(state, MIPI_CSIS_CMN_CTRL,
+			regs->cmn_ctrl | MIPI_CSIS_CMN_CTRL_UPDATE_SHADOW);
 }
 
 static void mipi_csis_clk_enable(struct csi_state *state)
@@ -615,16 +730,52 @@ static void dump_regs(struct csi_state *state, const char *label)
 	}
 }
 
+static void mipi_csis_get_hw_config(struct csi_state *state,
+				    struct csis_hw_config *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->fmt_reg = state->csis_fmt->fmt_reg;
+	cfg->data_alignment = state->csis_fmt->data_alignment;
+	cfg->width = state->format.width;
+	cfg->height = state->format.height;
+	cfg->num_lanes = state->num_lanes;
+	cfg->hs_settle = state->hs_settle;
+	cfg->clk_settle = state->clk_settle;
+	cfg->wclk_ext = state->wclk_ext;
+}
+
 static void mipi_csis_start_stream(struct csi_state *state)
 {
-	mipi_csis_sw_reset(state);
-	mipi_csis_set_params(state);
+	struct csis_hw_config cfg;
+	bool warm;
+
+	/*
+	 * The configuration registers survive a stream stop, only a power
+	 * loss clears them. Skip the reset and reprogramming when nothing
+	 * changed since the last start.
+	 */
+	mipi_csis_get_hw_config(state, &cfg);
+	warm = state->hw_cfg_valid && !memcmp(&cfg, &state->hw_cfg, sizeof(cfg));
+	if (!warm) {
+		mipi_csis_sw_reset(state);
+		mipi_csis_set_params(state);
+		state->hw_cfg = cfg;
+		state->hw_cfg_valid = true;
+	}
+
 	mipi_csis_system_enable(state, true);
 	mipi_csis_enable_interrupts(state, true);
+
+	v4l2_dbg(1, debug, &state->mipi_sd, "%s start\n",
+		 warm ? "warm" : "cold");
 }
 
 static void mipi_csis_stop_stream(struct csi_state *state)
 {
+	/* Not started since power up, @regs does not reflect the hardware */
+	if (!state->hw_cfg_valid)
+		return;
+
 	mipi_csis_enable_interrupts(state, false);
 	mipi_csis_system_enable(state, false);
 }
@@ -653,6 +804,9 @@ static void mipi_csis_log_counters(struct csi_state *state, bool non_errors)
 				  state->events[i].name,
 				  state->events[i].counter);
 	}
+	if (state->meta_dropped > 0 || debug)
+		v4l2_info(&state->mipi_sd, "Embedded data dropped: %u\n",
+			  state->meta_dropped);
 	spin_unlock_irqrestore(&state->slock, flags);
 }
 
@@ -669,7 +823,45 @@ static int mipi_csis_s_power(struct v4l2_subdev *mipi_sd, int on)
 	if (on)
 		return pm_runtime_get_sync(dev);
 
-	return pm_runtime_put_sync(dev);
+	pm_runtime_mark_last_busy(dev);
+	return pm_runtime_put_autosuspend(dev);
+}
+
+/*
+ * Use as many data lanes as the source transmits on, the source picks
+ * the fewest lanes that sustain its current mode. Sources that don't
+ * report their bus configuration get all the lanes wired in DT.
+ *
+ * The DT hs_settle is kept for every lane count. Dropping lanes only
+ * happens when the remaining ones still run close to the top rate, so
+ * with the ADV7482 (891 Mbps per lane, 13 MHz lowest pixel clock) the
+ * per-lane rate stays within 312-891 Mbps. The Ths-settle windows of
+ * that range (85 ns + 6 UI to 145 ns + 10 UI) all overlap in 104-156 ns,
+ * so a DT value in there is valid for any negotiated lane count.
+ * Called with the state.lock mutex held.
+ */
+static void mipi_csis_negotiate_lanes(struct csi_state *state)
+{
+	struct v4l2_mbus_config cfg = { 0 };
+	unsigned int lanes = state->dt_num_lanes;
+	int ret;
+
+	ret = v4l2_subdev_call(state->sensor_sd, pad, get_mbus_config, 0, &cfg);
+	if (!ret && cfg.type == V4L2_MBUS_CSI2_DPHY) {
+		if (cfg.bus.mipi_csi2.num_data_lanes &&
+		    cfg.bus.mipi_csi2.num_data_lanes <= state->dt_num_lanes)
+			lanes = cfg.bus.mipi_csi2.num_data_lanes;
+		else
+			v4l2_warn(&state->mipi_sd,
+				  "source requests %u lanes, %u wired\n",
+				  cfg.bus.mipi_csi2.num_data_lanes,
+				  state->dt_num_lanes);
+	}
+
+	if (lanes != state->num_lanes)
+		v4l2_dbg(1, debug, &state->mipi_sd, "using %u data lanes\n",
+			 lanes);
+	state->num_lanes = lanes;
 }
 
 static int mipi_csis_s_stream(struct v4l2_subdev *mipi_sd, int enable)
@@ -682,6 +874,7 @@ static int mipi_csis_s_stream(struct v4l2_subdev *mipi_sd, int enable)
 
 	if (enable) {
 		mipi_csis_clear_counters(state);
+		state->frame_seq = 0;
 		ret = pm_runtime_get_sync(&state->pdev->dev);
 		if (ret && ret != 1)
 			return ret;
@@ -693,8 +886,14 @@ static int mipi_csis_s_stream(struct v4l2_subdev *mipi_sd, int enable)
 			ret = -EBUSY;
 			goto unlock;
 		}
+		mipi_csis_negotiate_lanes(state);
 		mipi_csis_start_stream(state);
-		v4l2_subdev_call(state->sensor_sd, video, s_stream, true);
+		ret = v4l2_subdev_call(state->sensor_sd, video, s_stream, true);
+		if (ret < 0 && ret != -ENOIOCTLCMD) {
+			mipi_csis_stop_stream(state);
+			goto unlock;
+		}
+		ret = 0;
 		state->flags |= ST_STREAMING;
 	} else {
 		v4l2_subdev_call(state->sensor_sd, video, s_stream, false);
@@ -705,8 +904,10 @@ static int mipi_csis_s_stream(struct v4l2_subdev *mipi_sd, int enable)
 	}
 unlock:
 	mutex_unlock(&state->lock);
-	if (!enable)
-		pm_runtime_put(&state->pdev->dev);
+	if (!enable || ret < 0) {
+		pm_runtime_mark_last_busy(&state->pdev->dev);
+		pm_runtime_put_autosuspend(&state->pdev->dev);
+	}
 
 	return ret == 1 ? 0 : ret;
 }
@@ -816,6 +1017,44 @@ static int mipi_csis_g_parm(struct v4l2_subdev *mipi_sd, struct v4l2_streamparm
 	return v4l2_subdev_call(sensor_sd, video, g_parm, a);
 }
 
+static int mipi_csis_g_frame_interval(struct v4l2_subdev *mipi_sd,
+				     struct v4l2_subdev_frame_interval *fi)
+{
+	struct csi_state *state = mipi_sd_to_csi_state(mipi_sd);
+	struct v4l2_subdev *sensor_sd = state->sensor_sd;
+
+	return v4l2_subdev_call(sensor_sd, video, g_frame_interval, fi);
+}
+
+static int mipi_csis_s_routing(struct v4l2_subdev *mipi_sd, u32 input,
+			       u32 output, u32 config)
+{
+	struct csi_state *state = mipi_sd_to_csi_state(mipi_sd);
+	struct v4l2_subdev *sensor_sd = state->sensor_sd;
+
+	return v4l2_subdev_call(sensor_sd, video, s_routing, input, output,
+				config);
+}
+
+static long mipi_csis_ioctl(struct v4l2_subdev *mipi_sd, unsigned int cmd,
+			    void *arg)
+{
+	struct csi_state *state = mipi_sd_to_csi_state(mipi_sd);
+	struct v4l2_subdev *sensor_sd = state->sensor_sd;
+
+	return v4l2_subdev_call(sensor_sd, core, ioctl, cmd, arg);
+}
+
+/* The sensor is bound to our v4l2_device, pass its notifications on */
+static void mipi_csis_notify(struct v4l2_subdev *sd, unsigned int notification,
+			     void *arg)
+{
+	struct csi_state *state = container_of(sd->v4l2_dev, struct csi_state,
+					       v4l2_dev);
+
+	v4l2_subdev_notify(&state->mipi_sd, notification, arg);
+}
+
 static int mipi_csis_enum_framesizes(struct v4l2_subdev *mipi_sd,
 		struct v4l2_subdev_state *sd_state,
 		struct v4l2_subdev_frame_size_enum *fse)
@@ -851,6 +1090,7 @@ static int mipi_csis_log_status(struct v4l2_subdev *mipi_sd)
 static struct v4l2_subdev_core_ops mipi_csis_core_ops = {
 	.s_power = mipi_csis_s_power,
 	.log_status = mipi_csis_log_status,
+	.ioctl = mipi_csis_ioctl,
 };
 
 static struct v4l2_subdev_video_ops mipi_csis_video_ops = {
@@ -859,6 +1099,8 @@ static struct v4l2_subdev_video_ops mipi_csis_video_ops = {
 
 	.s_parm = mipi_csis_s_parm,
 	.g_parm = mipi_csis_g_parm,
+	.s_routing = mipi_csis_s_routing,
+	.g_frame_interval = mipi_csis_g_frame_interval,
 };
 
 static const struct v4l2_subdev_pad_ops mipi_csis_pad_ops = {
@@ -875,10 +1117,80 @@ static struct v4l2_subdev_ops mipi_csis_subdev_ops = {
 	.pad = &mipi_csis_pad_ops,
 };
 
+/*
+ * Copy the embedded data packet at @offset into the next ring slot,
+ * overwriting the oldest one if userspace has fallen behind. Returns NULL
+ * and drops the packet if that slot is still being copied out.
+ * Called with state->slock held.
+ */
+static struct csis_meta_slot *mipi_csis_meta_fill(struct csi_state *state,
+						  u32 offset, u32 frame)
+{
+	struct csis_meta_slot *slot;
+
+	if (state->meta_head - state->meta_tail == MIPI_CSIS_META_RING_SIZE) {
+		state->meta_tail++;
+		state->meta_dropped++;
+	}
+
+	slot = &state->meta_ring[state->meta_head % MIPI_CSIS_META_RING_SIZE];
+	if (slot == state->meta_copy) {
+		state->meta_dropped++;
+		return NULL;
+	}
+	slot->frame = frame;
+	slot->timestamp = ktime_get_ns();
+	slot->len = state->meta_len;
+	memcpy_fromio(slot->data, state->regs + offset, slot->len);
+	state->meta_head++;
+
+	return slot;
+}
+
+/*
+ * Hand the filled ring slots over to the queued metadata buffers.
+ * Each slot is claimed under state->slock and copied with interrupts
+ * enabled; mipi_csis_meta_fill() leaves the claimed slot alone.
+ */
+static void mipi_csis_meta_drain(struct csi_state *state)
+{
+	struct csis_meta_buffer *buf;
+	struct csis_meta_slot *slot;
+	struct vb2_buffer *vb;
+	unsigned long flags;
+
+	mutex_lock(&state->meta_drain_lock);
+	spin_lock_irqsave(&state->slock, flags);
+	while (state->meta_tail != state->meta_head &&
+	       !list_empty(&state->meta_bufs)) {
+		slot = &state->meta_ring[state->meta_tail % MIPI_CSIS_META_RING_SIZE];
+		buf = list_first_entry(&state->meta_bufs,
+				       struct csis_meta_buffer, list);
+		list_del(&buf->list);
+		state->meta_copy = slot;
+		state->meta_tail++;
+		spin_unlock_irqrestore(&state->slock, flags);
+
+		vb = &buf->vb.vb2_buf;
+		memcpy(vb2_plane_vaddr(vb, 0), slot->data, slot->len);
+		vb2_set_plane_payload(vb, 0, slot->len);
+		vb->timestamp = slot->timestamp;
+		buf->vb.sequence = slot->frame;
+		buf->vb.field = V4L2_FIELD_NONE;
+		vb2_buffer_done(vb, VB2_BUF_STATE_DONE);
+
+		spin_lock_irqsave(&state->slock, flags);
+		state->meta_copy = NULL;
+	}
+	spin_unlock_irqrestore(&state->slock, flags);
+	mutex_unlock(&state->meta_drain_lock);
+}
+
 static irqreturn_t mipi_csis_irq_handler(int irq, void *dev_id)
 {
 	struct csi_state *state = dev_id;
 	struct csis_pktbuf *pktbuf = &state->pkt_buf;
+	irqreturn_t ret = IRQ_HANDLED;
 	unsigned long flags;
 	u32 status;
 
@@ -886,19 +1198,46 @@ static irqreturn_t mipi_csis_irq_handler(int irq, void *dev_id)
 
 	spin_lock_irqsave(&state->slock, flags);
 
-	if ((status & MIPI_CSIS_INTSRC_NON_IMAGE_DATA) && pktbuf->data) {
-		u32 offset;
+	/*
+	 * Embedded data is handled before the frame start of the same
+	 * interrupt is counted: data sent before a frame belongs to the
+	 * upcoming one, data sent after a frame to the last started one.
+	 */
+	if ((status & MIPI_CSIS_INTSRC_NON_IMAGE_DATA) &&
+	    (state->meta_streaming || pktbuf->data)) {
+		struct csis_meta_slot *slot;
+		u32 offset, frame;
 
 		if (status & MIPI_CSIS_INTSRC_EVEN)
 			offset = MIPI_CSIS_PKTDATA_EVEN;
 		else
 			offset = MIPI_CSIS_PKTDATA_ODD;
 
-		memcpy(pktbuf->data, state->regs + offset, pktbuf->len);
-		pktbuf->data = NULL;
-		rmb();
+		frame = state->frame_seq;
+		if (frame && (status & (MIPI_CSIS_INTSRC_EVEN_AFTER |
+					MIPI_CSIS_INTSRC_ODD_AFTER)))
+			frame--;
+
+		slot = mipi_csis_meta_fill(state, offset, frame);
+
+		if (pktbuf->data) {
+			if (slot)
+				memcpy(pktbuf->data, slot->data,
+				       min(pktbuf->len, slot->len));
+			else
+				memcpy_fromio(pktbuf->data,
+					      state->regs + offset,
+					      min(pktbuf->len, state->meta_len));
+			pktbuf->data = NULL;
+		}
+
+		if (slot && state->meta_streaming)
+			ret = IRQ_WAKE_THREAD;
 	}
 
+	if (status & MIPI_CSIS_INTSRC_FRAME_START)
+		state->frame_seq++;
+
 	/* Update the event/error counters */
 	if ((status & MIPI_CSIS_INTSRC_ERRORS) || debug) {
 		int i;
@@ -915,9 +1254,220 @@ static irqreturn_t mipi_csis_irq_handler(int irq, void *dev_id)
 	spin_unlock_irqrestore(&state->slock, flags);
 
 	mipi_csis_write(state, MIPI_CSIS_INTSRC, status);
+	return ret;
+}
+
+static irqreturn_t mipi_csis_irq_thread(int irq, void *dev_id)
+{
+	struct csi_state *state = dev_id;
+
+	mipi_csis_meta_drain(state);
+
 	return IRQ_HANDLED;
 }
 
+/*
+ * Embedded data capture video node
+ */
+static int mipi_csis_meta_queue_setup(struct vb2_queue *vq,
+				      unsigned int *nbuffers,
+				      unsigned int *nplanes,
+				      unsigned int sizes[],
+				      struct device *alloc_devs[])
+{
+	struct csi_state *state = vb2_get_drv_priv(vq);
+
+	if (*nplanes)
+		return sizes[0] < state->meta_len ? -EINVAL : 0;
+
+	*nplanes = 1;
+	sizes[0] = state->meta_len;
+	if (*nbuffers < MIPI_CSIS_META_RING_SIZE)
+		*nbuffers = MIPI_CSIS_META_RING_SIZE;
+
+	return 0;
+}
+
+static int mipi_csis_meta_buf_prepare(struct vb2_buffer *vb)
+{
+	struct csi_state *state = vb2_get_drv_priv(vb->vb2_queue);
+
+	if (vb2_plane_size(vb, 0) < state->meta_len)
+		return -EINVAL;
+
+	return 0;
+}
+
+static void mipi_csis_meta_buf_queue(struct vb2_buffer *vb)
+{
+	struct csi_state *state = vb2_get_drv_priv(vb->vb2_queue);
+	struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(vb);
+	struct csis_meta_buffer *buf = container_of(vbuf,
+					struct csis_meta_buffer, vb);
+	unsigned long flags;
+
+	spin_lock_irqsave(&state->slock, flags);
+	list_add_tail(&buf->list, &state->meta_bufs);
+	spin_unlock_irqrestore(&state->slock, flags);
+
+	mipi_csis_meta_drain(state);
+}
+
+static int mipi_csis_meta_start_streaming(struct vb2_queue *vq,
+					  unsigned int count)
+{
+	struct csi_state *state = vb2_get_drv_priv(vq);
+	unsigned long flags;
+
+	spin_lock_irqsave(&state->slock, flags);
+	state->meta_head = 0;
+	state->meta_tail = 0;
+	state->meta_dropped = 0;
+	state->meta_streaming = true;
+	spin_unlock_irqrestore(&state->slock, flags);
+
+	return 0;
+}
+
+static void mipi_csis_meta_stop_streaming(struct vb2_queue *vq)
+{
+	struct csi_state *state = vb2_get_drv_priv(vq);
+	struct csis_meta_buffer *buf, *tmp;
+	unsigned long flags;
+
+	/* Wait for a drain in progress to complete its buffer */
+	mutex_lock(&state->meta_drain_lock);
+	spin_lock_irqsave(&state->slock, flags);
+	state->meta_streaming = false;
+	list_for_each_entry_safe(buf, tmp, &state->meta_bufs, list) {
+		list_del(&buf->list);
+		vb2_buffer_done(&buf->vb.vb2_buf, VB2_BUF_STATE_ERROR);
+	}
+	spin_unlock_irqrestore(&state->slock, flags);
+	mutex_unlock(&state->meta_drain_lock);
+}
+
+static const struct vb2_ops mipi_csis_meta_qops = {
+	.queue_setup		= mipi_csis_meta_queue_setup,
+	.buf_prepare		= mipi_csis_meta_buf_prepare,
+	.buf_queue		= mipi_csis_meta_buf_queue,
+	.start_streaming	= mipi_csis_meta_start_streaming,
+	.stop_streaming		= mipi_csis_meta_stop_streaming,
+	.wait_prepare		= vb2_ops_wait_prepare,
+	.wait_finish		= vb2_ops_wait_finish,
+};
+
+static int mipi_csis_meta_querycap(struct file *file, void *priv,
+				   struct v4l2_capability *cap)
+{
+	struct csi_state *state = video_drvdata(file);
+
+	strscpy(cap->driver, CSIS_DRIVER_NAME, sizeof(cap->driver));
+	strscpy(cap->card, state->meta_vdev.name, sizeof(cap->card));
+	snprintf(cap->bus_info, sizeof(cap->bus_info), "platform:%s",
+		 dev_name(state->dev));
+
+	return 0;
+}
+
+static int mipi_csis_meta_enum_fmt(struct file *file, void *priv,
+				   struct v4l2_fmtdesc *f)
+{
+	if (f->index > 0)
+		return -EINVAL;
+
+	f->pixelformat = MIPI_CSIS_META_FMT_EMBEDDED;
+
+	return 0;
+}
+
+static int mipi_csis_meta_g_fmt(struct file *file, void *priv,
+				struct v4l2_format *f)
+{
+	struct csi_state *state = video_drvdata(file);
+
+	f->fmt.meta.dataformat = MIPI_CSIS_META_FMT_EMBEDDED;
+	f->fmt.meta.buffersize = state->meta_len;
+
+	return 0;
+}
+
+static const struct v4l2_ioctl_ops mipi_csis_meta_ioctl_ops = {
+	.vidioc_querycap		= mipi_csis_meta_querycap,
+	.vidioc_enum_fmt_meta_cap	= mipi_csis_meta_enum_fmt,
+	.vidioc_g_fmt_meta_cap		= mipi_csis_meta_g_fmt,
+	.vidioc_s_fmt_meta_cap		= mipi_csis_meta_g_fmt,
+	.vidioc_try_fmt_meta_cap	= mipi_csis_meta_g_fmt,
+	.vidioc_reqbufs			= vb2_ioctl_reqbufs,
+	.vidioc_create_bufs		= vb2_ioctl_create_bufs,
+	.vidioc_prepare_buf		= vb2_ioctl_prepare_buf,
+	.vidioc_querybuf		= vb2_ioctl_querybuf,
+	.vidioc_qbuf			= vb2_ioctl_qbuf,
+	.vidioc_dqbuf			= vb2_ioctl_dqbuf,
+	.vidioc_expbuf			= vb2_ioctl_expbuf,
+	.vidioc_streamon		= vb2_ioctl_streamon,
+	.vidioc_streamoff		= vb2_ioctl_streamoff,
+};
+
+static const struct v4l2_file_operations mipi_csis_meta_fops = {
+	.owner		= THIS_MODULE,
+	.open		= v4l2_fh_open,
+	.release	= vb2_fop_release,
+	.poll		= vb2_fop_poll,
+	.mmap		= vb2_fop_mmap,
+	.unlocked_ioctl	= video_ioctl2,
+};
+
+static int mipi_csis_meta_register(struct csi_state *state)
+{
+	struct video_device *vdev = &state->meta_vdev;
+	struct vb2_queue *q = &state->meta_queue;
+	int ret;
+
+	state->meta_len = clamp_t(unsigned int, ALIGN(embedded_data_size, 4),
+				  4, MIPI_CSIS_PKTDATA_SIZE);
+	state->meta_ring = devm_kcalloc(state->dev, MIPI_CSIS_META_RING_SIZE,
+					sizeof(*state->meta_ring), GFP_KERNEL);
+	if (!state->meta_ring)
+		return -ENOMEM;
+
+	INIT_LIST_HEAD(&state->meta_bufs);
+	mutex_init(&state->meta_lock);
+	mutex_init(&state->meta_drain_lock);
+
+	q->type = V4L2_BUF_TYPE_META_CAPTURE;
+	q->io_modes = VB2_MMAP | VB2_USERPTR | VB2_DMABUF;
+	q->drv_priv = state;
+	q->buf_struct_size = sizeof(struct csis_meta_buffer);
+	q->ops = &mipi_csis_meta_qops;
+	q->mem_ops = &vb2_vmalloc_memops;
+	q->timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+	q->lock = &state->meta_lock;
+	q->dev = state->dev;
+
+	ret = vb2_queue_init(q);
+	if (ret)
+		return ret;
+
+	snprintf(vdev->name, sizeof(vdev->name), "%s.%d-meta",
+		 CSIS_SUBDEV_NAME, state->index);
+	vdev->fops = &mipi_csis_meta_fops;
+	vdev->ioctl_ops = &mipi_csis_meta_ioctl_ops;
+	vdev->release = video_device_release_empty;
+	vdev->v4l2_dev = &state->v4l2_dev;
+	vdev->vfl_dir = VFL_DIR_RX;
+	vdev->device_caps = V4L2_CAP_META_CAPTURE | V4L2_CAP_STREAMING;
+	vdev->queue = q;
+	vdev->lock = &state->meta_lock;
+	video_set_drvdata(vdev, state);
+
+	ret = video_register_device(vdev, VFL_TYPE_VIDEO, -1);
+	if (ret)
+		vb2_queue_release(q);
+
+	return ret;
+}
+
 static int subdev_notifier_bound(struct v4l2_async_notifier *notifier,
 			    struct v4l2_subdev *subdev,
 			    struct v4l2_async_subdev *asd)
@@ -966,7 +1516,8 @@ static int mipi_csis_parse_dt(struct platform_device *pdev,
 					"csis-wclk");
 
 	of_property_read_u32(node, "data-lanes",
-					&state->num_lanes);
+					&state->dt_num_lanes);
+	state->num_lanes = state->dt_num_lanes;
 	of_node_put(node);
 
 	return 0;
@@ -1090,9 +1641,10 @@ static int mipi_csis_probe(struct platform_device *pdev)
 	if (ret < 0)
 		return ret;
 
-	if (state->num_lanes == 0 || state->num_lanes > state->max_num_lanes) {
+	if (state->dt_num_lanes == 0 ||
+	    state->dt_num_lanes > state->max_num_lanes) {
 		dev_err(dev, "Unsupported number of data lanes: %d (max. %d)\n",
-			state->num_lanes, state->max_num_lanes);
+			state->dt_num_lanes, state->max_num_lanes);
 		return -EINVAL;
 	}
 
@@ -1122,14 +1674,16 @@ static int mipi_csis_probe(struct platform_device *pdev)
 
 	phy_reset_fn(state);
 
-	ret = devm_request_irq(dev, state->irq, mipi_csis_irq_handler,
-			       0, dev_name(dev), state);
+	ret = devm_request_threaded_irq(dev, state->irq, mipi_csis_irq_handler,
+					mipi_csis_irq_thread, 0,
+					dev_name(dev), state);
 	if (ret) {
 		dev_err(dev, "Interrupt request failed\n");
 		goto e_clkdis;
 	}
 
 	/* First register a v4l2 device */
+	state->v4l2_dev.notify = mipi_csis_notify;
 	ret = v4l2_device_register(dev, &state->v4l2_dev);
 	if (ret) {
 		v4l2_err(dev->driver,
@@ -1143,15 +1697,23 @@ static int mipi_csis_probe(struct platform_device *pdev)
 
 	ret = mipi_csis_subdev_init(&state->mipi_sd, pdev, &mipi_csis_subdev_ops);
 	if (ret < 0)
-		goto e_sd_mipi;
+		goto e_v4l2;
 
 	memcpy(state->events, mipi_csis_events, sizeof(state->events));
 
+	ret = mipi_csis_meta_register(state);
+	if (ret < 0) {
+		dev_err(dev, "Failed to register metadata node, ret=%d\n", ret);
+		goto e_sd_mipi;
+	}
+
 	/* subdev host register */
 	ret = mipi_csis_subdev_host(state);
 	if (ret < 0)
-		goto e_sd_host;
+		goto e_nf;
 
+	pm_runtime_set_autosuspend_delay(dev, autosuspend_delay_ms);
+	pm_runtime_use_autosuspend(dev);
 	pm_runtime_enable(dev);
 	if (!pm_runtime_enabled(dev)) {
 		ret = mipi_csis_pm_resume(dev, true);
@@ -1168,9 +1730,13 @@ static int mipi_csis_probe(struct platform_device *pdev)
 
 e_sd_host:
 	v4l2_async_nf_unregister(&state->subdev_notifier);
-	v4l2_device_unregister(&state->v4l2_dev);
+e_nf:
+	v4l2_async_nf_cleanup(&state->subdev_notifier);
+	vb2_video_unregister_device(&state->meta_vdev);
 e_sd_mipi:
 	v4l2_async_unregister_subdev(&state->mipi_sd);
+e_v4l2:
+	v4l2_device_unregister(&state->v4l2_dev);
 e_clkdis:
 	mipi_csis_clk_disable(state);
 	return ret;
@@ -1194,6 +1760,7 @@ static int mipi_csis_pm_suspend(struct device *dev, bool runtime)
 			goto unlock;
 		mipi_csis_clk_disable(state);
 		state->flags &= ~ST_POWERED;
+		state->hw_cfg_valid = false;
 		if (!runtime)
 			state->flags |= ST_SUSPENDED;
 	}
@@ -1271,8 +1838,10 @@ static int mipi_csis_remove(struct platform_device *pdev)
 	v4l2_async_unregister_subdev(&state->mipi_sd);
 	v4l2_async_nf_cleanup(&state->subdev_notifier);
 	v4l2_async_nf_unregister(&state->subdev_notifier);
+	vb2_video_unregister_device(&state->meta_vdev);
 	v4l2_device_unregister(&state->v4l2_dev);
 
+	pm_runtime_dont_use_autosuspend(&pdev->dev);
 	pm_runtime_disable(&pdev->dev);
 	mipi_csis_pm_suspend(&pdev->dev, true);
 	pm_runtime_set_suspended(&pdev->dev);